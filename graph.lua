@@ -23,10 +23,12 @@ else
    })
 end
 --
--- Overloaded graph.open(), graph.read()
+-- Overloaded graph.open(), graph.read(), graph.readall(), graph.load()
 --
 local _open = open
 local _read = read
+local _readall = readall
+local _load = load
 
 --==============================================================================
 -- Constants
@@ -552,6 +554,29 @@ function read(fname, doscan)
   end
 end
 
+--
+-- Iterate over all graphs in a file: for g in graph.readall(fname) do ... end
+--
+function readall(fname)
+  local iter, err = _readall(fname)
+  if not iter then return iter, err end
+  return function()
+    local g = iter()
+    if g then overload(g) end
+    return g
+  end
+end
+
+--
+-- Load a graph from a binary snapshot written by g:save()
+--
+function load(fname)
+  local g, err = _load(fname)
+  if not g then return g, err end
+  overload(g)
+  return g
+end
+
 --==============================================================================
 -- Utilities to create a graph as Lua table.
 -- Each of the following functions returns a constructor function for
@@ -0,0 +1,1285 @@
+/*=========================================================================*\
+ * LuaGRAPH toolkit
+ * Graph support for Lua.
+ * Herbert Leuwer
+ * 30-7-2006, 01/2017
+ *
+ * Graph algorithms on a compressed sparse row snapshot of a graph.
+ *
+\*=========================================================================*/
+
+/*=========================================================================*\
+ * Includes
+\*=========================================================================*/
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#ifdef USE_PTHREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "gr_graph.h"
+
+/*=========================================================================*\
+ * Defines
+\*=========================================================================*/
+#define CSR_REVERSE (1)   /* rows hold in-edges of directed graphs */
+#define MAXTHREADS (64)
+
+/*=========================================================================*\
+ * Data
+\*=========================================================================*/
+/*
+ * Adjacency snapshot in compressed sparse row format. Nodes are numbered
+ * 0..n-1 in node sequence order, the neighbours of node i are
+ * col[off[i]] .. col[off[i+1]-1]. Undirected graphs hold every edge in
+ * the rows of both end nodes.
+ */
+struct gr_csr_s {
+  Agraph_t *g;
+  int n;
+  int m;
+  Agnode_t **nodes;    /* node by index */
+  int *idx;            /* index by node sequence number */
+  int *off;
+  int *col;
+  double *w;           /* edge weights or NULL */
+};
+typedef struct gr_csr_s gr_csr_t;
+
+/*
+ * Worker pool: pool_run() executes a job function on all threads, the 
+ * calling thread being thread 0, and returns when all are done.
+ */
+typedef void (pool_job_t)(void *arg, int tid, int nthreads);
+
+struct gr_pool_s {
+  int nthreads;
+  pool_job_t *job;
+  void *arg;
+#ifdef USE_PTHREADS
+  pthread_t tids[MAXTHREADS];
+  pthread_mutex_t mtx;
+  pthread_cond_t go;
+  pthread_cond_t done;
+  unsigned long gen;
+  int pending;
+  int quit;
+#endif
+};
+typedef struct gr_pool_s gr_pool_t;
+
+/*=========================================================================*\
+ * Functions
+\*=========================================================================*/
+/*-------------------------------------------------------------------------*\
+ * Adjacency snapshot
+\*-------------------------------------------------------------------------*/
+static void csr_free(gr_csr_t *c)
+{
+  free(c->nodes);
+  free(c->idx);
+  free(c->off);
+  free(c->col);
+  free(c->w);
+  memset(c, 0, sizeof(gr_csr_t));
+}
+
+/*
+ * Parse an edge weight. Empty values count as 1.
+ */
+static int csr_weight(const char *s, double *w)
+{
+  char *end;
+
+  if (s == NULL || *s == '\0'){
+    *w = 1.0;
+    return 0;
+  }
+  *w = strtod(s, &end);
+  return (end == s) ? -1 : 0;
+}
+
+/*
+ * Build the adjacency snapshot of graph g. Weights are parsed once from
+ * edge attribute wattr if given. With CSR_REVERSE the rows of a directed
+ * graph hold the predecessors instead of the successors of a node.
+ * Returns 0 on success or -1 with an error message in err.
+ */
+static int csr_build(Agraph_t *g, const char *wattr, int flags, gr_csr_t *c, const char **err)
+{
+  Agnode_t *n;
+  Agedge_t *e;
+  Agsym_t *sym = NULL;
+  gr_numattr_t *num = NULL;
+  size_t maxseq = 0;
+  int i, u, v, *pos = NULL;
+  int directed = agisdirected(g);
+  int reverse = directed && (flags & CSR_REVERSE);
+  double w;
+
+  memset(c, 0, sizeof(gr_csr_t));
+  c->g = g;
+  c->n = agnnodes(g);
+  if (wattr != NULL && (num = numattr_find(g, AGEDGE, wattr)) == NULL &&
+      (sym = agattr(agroot(g), AGEDGE, (char *) wattr, NULL)) == NULL){
+    *err = "unknown edge attribute";
+    return -1;
+  }
+  *err = "out of memory";
+  for (n = agfstnode(g); n; n = agnxtnode(g, n))
+    if (AGSEQ(n) > maxseq)
+      maxseq = AGSEQ(n);
+  if ((c->nodes = malloc(c->n * sizeof(Agnode_t *) + 1)) == NULL ||
+      (c->idx = malloc((maxseq + 1) * sizeof(int))) == NULL ||
+      (c->off = calloc(c->n + 1, sizeof(int))) == NULL)
+    goto fail;
+
+  /* Number nodes and count row lengths */
+  for (i = 0, n = agfstnode(g); n; n = agnxtnode(g, n), i++){
+    c->nodes[i] = n;
+    c->idx[AGSEQ(n)] = i;
+  }
+  for (n = agfstnode(g); n; n = agnxtnode(g, n))
+    for (e = agfstout(g, n); e; e = agnxtout(g, e)){
+      u = c->idx[AGSEQ(agtail(e))];
+      v = c->idx[AGSEQ(aghead(e))];
+      if (!directed){
+        c->off[u + 1]++;
+        if (u != v)
+          c->off[v + 1]++;
+      } else
+        c->off[(reverse ? v : u) + 1]++;
+    }
+  for (i = 0; i < c->n; i++)
+    c->off[i + 1] += c->off[i];
+  c->m = c->off[c->n];
+
+  /* Fill rows */
+  if ((c->col = malloc(c->m * sizeof(int) + 1)) == NULL ||
+      (wattr != NULL && (c->w = malloc(c->m * sizeof(double) + 1)) == NULL) ||
+      (pos = malloc(c->n * sizeof(int) + 1)) == NULL)
+    goto fail;
+  memcpy(pos, c->off, c->n * sizeof(int));
+  for (n = agfstnode(g); n; n = agnxtnode(g, n))
+    for (e = agfstout(g, n); e; e = agnxtout(g, e)){
+      u = c->idx[AGSEQ(agtail(e))];
+      v = c->idx[AGSEQ(aghead(e))];
+      w = 1.0;
+      if (num != NULL)
+        numattr_get(num, e, &w);
+      else if (sym != NULL && csr_weight(agxget(e, sym), &w)){
+        *err = "invalid edge weight";
+        goto fail;
+      }
+      if (reverse){
+        i = v; v = u; u = i;
+      }
+      if (c->w != NULL)
+        c->w[pos[u]] = w;
+      c->col[pos[u]++] = v;
+      if (!directed && u != v){
+        if (c->w != NULL)
+          c->w[pos[v]] = w;
+        c->col[pos[v]++] = u;
+      }
+    }
+  free(pos);
+  return 0;
+
+fail:
+  free(pos);
+  csr_free(c);
+  return -1;
+}
+
+/*
+ * Push an array of n integers; base is added to each value. Lua 5.3 and
+ * later get integers, earlier versions integral numbers.
+ */
+static void push_intarray(lua_State *L, const int *a, int n, int base)
+{
+  int i;
+
+  lua_createtable(L, n, 0);
+  for (i = 0; i < n; i++){
+    lua_pushinteger(L, (lua_Integer) (a[i] + base));
+    lua_rawseti(L, -2, i + 1);
+  }
+}
+
+/*
+ * Retrieve the node given by userdata or name at stack index narg.
+ */
+static Agnode_t *checknode(lua_State *L, int narg, Agraph_t *g)
+{
+  if (lua_type(L, narg) == LUA_TSTRING)
+    return agnode(g, (char *) lua_tostring(L, narg), 0);
+  return agsubnode(g, tonode(L, narg, STRICT)->n, 0);
+}
+
+/*-------------------------------------------------------------------------*\
+ * Shortest paths
+\*-------------------------------------------------------------------------*/
+/*
+ * Indexed binary min-heap of node indices ordered by distance.
+ */
+struct heap_s {
+  int *h;          /* heap of node indices */
+  int *pos;        /* position in heap or -1 */
+  int n;
+  const double *key;
+};
+typedef struct heap_s heap_t;
+
+static void heap_swap(heap_t *hp, int i, int j)
+{
+  int t = hp->h[i];
+
+  hp->h[i] = hp->h[j];
+  hp->h[j] = t;
+  hp->pos[hp->h[i]] = i;
+  hp->pos[hp->h[j]] = j;
+}
+
+static void heap_up(heap_t *hp, int i)
+{
+  while (i > 0 && hp->key[hp->h[(i - 1) / 2]] > hp->key[hp->h[i]]){
+    heap_swap(hp, i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+static void heap_down(heap_t *hp, int i)
+{
+  int l, s;
+
+  for (;;){
+    l = 2 * i + 1;
+    s = i;
+    if (l < hp->n && hp->key[hp->h[l]] < hp->key[hp->h[s]])
+      s = l;
+    if (l + 1 < hp->n && hp->key[hp->h[l + 1]] < hp->key[hp->h[s]])
+      s = l + 1;
+    if (s == i)
+      return;
+    heap_swap(hp, i, s);
+    i = s;
+  }
+}
+
+/*
+ * Insert node v or move it up after its key decreased.
+ */
+static void heap_push(heap_t *hp, int v)
+{
+  if (hp->pos[v] < 0){
+    hp->h[hp->n] = v;
+    hp->pos[v] = hp->n++;
+  }
+  heap_up(hp, hp->pos[v]);
+}
+
+static int heap_pop(heap_t *hp)
+{
+  int v = hp->h[0];
+
+  heap_swap(hp, 0, --hp->n);
+  hp->pos[v] = -1;
+  heap_down(hp, 0);
+  return v;
+}
+
+/*
+ * Dijkstra's algorithm from node src. Stops early when node dst is 
+ * settled; dst < 0 computes all distances. Unreachable nodes have
+ * distance HUGE_VAL and predecessor -1.
+ * Returns 0 on success or -1 if out of memory.
+ */
+static int dijkstra(gr_csr_t *c, int src, int dst, double *dist, int *pred)
+{
+  heap_t hp;
+  int i, j, u, v;
+  double d;
+
+  if ((hp.h = malloc(c->n * sizeof(int) + 1)) == NULL ||
+      (hp.pos = malloc(c->n * sizeof(int) + 1)) == NULL){
+    free(hp.h);
+    return -1;
+  }
+  hp.n = 0;
+  hp.key = dist;
+  for (i = 0; i < c->n; i++){
+    dist[i] = HUGE_VAL;
+    pred[i] = -1;
+    hp.pos[i] = -1;
+  }
+  dist[src] = 0;
+  heap_push(&hp, src);
+  while (hp.n > 0){
+    u = heap_pop(&hp);
+    if (u == dst)
+      break;
+    for (j = c->off[u]; j < c->off[u + 1]; j++){
+      v = c->col[j];
+      d = dist[u] + (c->w ? c->w[j] : 1.0);
+      if (d < dist[v]){
+        dist[v] = d;
+        pred[v] = u;
+        heap_push(&hp, v);
+      }
+    }
+  }
+  free(hp.h);
+  free(hp.pos);
+  return 0;
+}
+
+/*
+ * Build the weighted snapshot for shortest path searches.
+ */
+static int sp_build(Agraph_t *g, const char *wattr, gr_csr_t *c, const char **err)
+{
+  int i;
+
+  if (csr_build(g, wattr, 0, c, err))
+    return -1;
+  for (i = 0; c->w != NULL && i < c->m; i++)
+    if (c->w[i] < 0){
+      csr_free(c);
+      *err = "negative edge weight";
+      return -1;
+    }
+  return 0;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Method: dist, pred = g.shortestpaths(self, src [, weightattr])
+ * Computes single-source shortest paths from node src (userdata or name)
+ * with Dijkstra's algorithm. Edge weights are taken from edge attribute 
+ * weightattr (default: all 1) and must not be negative. Nodes are numbered
+ * 1..N in the order of g:nodenames(). dist[i] is the distance of node i 
+ * (math.huge if unreachable) and pred[i] the number of its predecessor on
+ * a shortest path (0 for src and unreachable nodes).
+ * Returns two arrays on success, nil plus error message on failure.
+ * Example:
+ * dist, pred = g:shortestpaths("a", "weight")
+\*-------------------------------------------------------------------------*/
+int gr_shortestpaths(lua_State *L)
+{
+  gr_csr_t c;
+  const char *err;
+  Agnode_t *src;
+  double *dist;
+  int *pred, i;
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+  const char *wattr = luaL_optstring(L, 3, NULL);
+
+  if ((src = checknode(L, 2, ud->g)) == NULL){
+    lua_pushnil(L);
+    lua_pushstring(L, "node not found");
+    return 2;
+  }
+  if (sp_build(ud->g, wattr, &c, &err)){
+    lua_pushnil(L);
+    lua_pushstring(L, err);
+    return 2;
+  }
+  dist = malloc(c.n * sizeof(double) + 1);
+  pred = malloc(c.n * sizeof(int) + 1);
+  if (dist == NULL || pred == NULL || dijkstra(&c, c.idx[AGSEQ(src)], -1, dist, pred)){
+    free(dist);
+    free(pred);
+    csr_free(&c);
+    lua_pushnil(L);
+    lua_pushstring(L, "out of memory");
+    return 2;
+  }
+  lua_createtable(L, c.n, 0);                      /* ..., dist */
+  for (i = 0; i < c.n; i++){
+    lua_pushnumber(L, dist[i]);
+    lua_rawseti(L, -2, i + 1);
+  }
+  push_intarray(L, pred, c.n, 1);                  /* ..., dist, pred */
+  free(dist);
+  free(pred);
+  csr_free(&c);
+  return 2;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Method: t, d = g.path(self, src, dst [, weightattr])
+ * Finds a shortest path from node src to node dst (userdata or names).
+ * Edge weights are handled as in g:shortestpaths().
+ * Returns the array of node names on the path and its length, nil plus 
+ * error message if there is no path.
+ * Example:
+ * t, d = g:path("a", "z", "weight")
+\*-------------------------------------------------------------------------*/
+int gr_path(lua_State *L)
+{
+  gr_csr_t c;
+  const char *err;
+  Agnode_t *src, *dst;
+  double *dist, d;
+  int *pred, i, v, len;
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+  const char *wattr = luaL_optstring(L, 4, NULL);
+
+  if ((src = checknode(L, 2, ud->g)) == NULL || (dst = checknode(L, 3, ud->g)) == NULL){
+    lua_pushnil(L);
+    lua_pushstring(L, "node not found");
+    return 2;
+  }
+  if (sp_build(ud->g, wattr, &c, &err)){
+    lua_pushnil(L);
+    lua_pushstring(L, err);
+    return 2;
+  }
+  dist = malloc(c.n * sizeof(double) + 1);
+  pred = malloc(c.n * sizeof(int) + 1);
+  if (dist == NULL || pred == NULL ||
+      dijkstra(&c, c.idx[AGSEQ(src)], c.idx[AGSEQ(dst)], dist, pred)){
+    free(dist);
+    free(pred);
+    csr_free(&c);
+    lua_pushnil(L);
+    lua_pushstring(L, "out of memory");
+    return 2;
+  }
+  v = c.idx[AGSEQ(dst)];
+  d = dist[v];
+  if (d == HUGE_VAL){
+    free(dist);
+    free(pred);
+    csr_free(&c);
+    lua_pushnil(L);
+    lua_pushstring(L, "no path");
+    return 2;
+  }
+  for (len = 1, i = v; pred[i] >= 0; i = pred[i])
+    len++;
+  lua_createtable(L, len, 0);                      /* ..., t */
+  for (i = len; i > 0; i--, v = pred[v]){
+    lua_pushstring(L, agnameof(c.nodes[v]));
+    lua_rawseti(L, -2, i);
+  }
+  lua_pushnumber(L, d);                            /* ..., t, d */
+  free(dist);
+  free(pred);
+  csr_free(&c);
+  return 2;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Connectivity and ordering
+\*-------------------------------------------------------------------------*/
+/*
+ * Push the names of the nodes list[0..n-1] as array.
+ */
+static void push_names(lua_State *L, gr_csr_t *c, const int *list, int n)
+{
+  int i;
+
+  lua_createtable(L, n, 0);
+  for (i = 0; i < n; i++){
+    lua_pushstring(L, agnameof(c->nodes[list[i]]));
+    lua_rawseti(L, -2, i + 1);
+  }
+}
+
+/*
+ * Push the groups of nodes given by a node list partitioned at the
+ * offsets start[0..ngroups] as array of arrays of node names.
+ */
+static void push_groups(lua_State *L, gr_csr_t *c, const int *list, const int *start, int ngroups)
+{
+  int i;
+
+  lua_createtable(L, ngroups, 0);
+  for (i = 0; i < ngroups; i++){
+    push_names(L, c, list + start[i], start[i + 1] - start[i]);
+    lua_rawseti(L, -2, i + 1);
+  }
+}
+
+static int pushnomem(lua_State *L)
+{
+  lua_pushnil(L);
+  lua_pushstring(L, "out of memory");
+  return 2;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Method: t = g.scc(self)
+ * Computes the strongly connected components of a graph with Tarjan's 
+ * algorithm. The search is iterative and not limited by the C stack.
+ * Components are found in reverse topological order. 
+ * Returns an array of components, each an array of node names, or nil 
+ * plus error message.
+ * Example:
+ * for _, comp in ipairs(g:scc()) do print(table.concat(comp, " ")) end
+\*-------------------------------------------------------------------------*/
+int gr_scc(lua_State *L)
+{
+  gr_csr_t c;
+  const char *err;
+  int *index, *low, *stack, *cs, *ce, *list, *start;
+  int i, u, v, sp, csp, nlist, ngroups, counter;
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+
+  if (csr_build(ud->g, NULL, 0, &c, &err)){
+    lua_pushnil(L);
+    lua_pushstring(L, err);
+    return 2;
+  }
+  /* index[v] < 0: unvisited; stack membership is marked by low[v] >= 0 */
+  index = malloc(c.n * sizeof(int) + 1);
+  low = malloc(c.n * sizeof(int) + 1);
+  stack = malloc(c.n * sizeof(int) + 1);
+  cs = malloc(c.n * sizeof(int) + 1);     /* call stack: node */
+  ce = malloc(c.n * sizeof(int) + 1);     /* call stack: next edge */
+  list = malloc(c.n * sizeof(int) + 1);
+  start = malloc((c.n + 1) * sizeof(int));
+  if (!index || !low || !stack || !cs || !ce || !list || !start){
+    free(index); free(low); free(stack); free(cs); free(ce); free(list); free(start);
+    csr_free(&c);
+    return pushnomem(L);
+  }
+  for (i = 0; i < c.n; i++)
+    index[i] = -1;
+  counter = sp = nlist = ngroups = 0;
+  for (i = 0; i < c.n; i++){
+    if (index[i] >= 0)
+      continue;
+    csp = 0;
+    cs[csp] = i;
+    ce[csp++] = c.off[i];
+    index[i] = low[i] = counter++;
+    stack[sp++] = i;
+    while (csp > 0){
+      u = cs[csp - 1];
+      if (ce[csp - 1] < c.off[u + 1]){
+        v = c.col[ce[csp - 1]++];
+        if (index[v] < 0){
+          /* descend */
+          index[v] = low[v] = counter++;
+          stack[sp++] = v;
+          cs[csp] = v;
+          ce[csp++] = c.off[v];
+        } else if (low[v] >= 0 && index[v] < low[u])
+          low[u] = index[v];
+        continue;
+      }
+      /* all successors done: return from u */
+      csp--;
+      if (low[u] == index[u]){
+        start[ngroups++] = nlist;
+        do {
+          v = stack[--sp];
+          low[v] = -1;
+          list[nlist++] = v;
+        } while (v != u);
+      } else if (low[u] < low[cs[csp - 1]])
+        low[cs[csp - 1]] = low[u];
+    }
+  }
+  start[ngroups] = nlist;
+  push_groups(L, &c, list, start, ngroups);
+  free(index); free(low); free(stack); free(cs); free(ce); free(list); free(start);
+  csr_free(&c);
+  return 1;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Method: t = g.toposort(self)
+ * Sorts the nodes of a directed graph topologically (Kahn's algorithm).
+ * Returns an array of node names. If the graph has a cycle, nil, an error 
+ * message and an array with the node names of one cycle are returned.
+ * Example:
+ * order, err, cycle = g:toposort()
+\*-------------------------------------------------------------------------*/
+int gr_toposort(lua_State *L)
+{
+  gr_csr_t c, rc;
+  const char *err;
+  int *indeg, *order, *mark;
+  int i, j, u, v, head, tail, len;
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+
+  if (!agisdirected(ud->g)){
+    lua_pushnil(L);
+    lua_pushstring(L, "directed graph expected");
+    return 2;
+  }
+  if (csr_build(ud->g, NULL, 0, &c, &err)){
+    lua_pushnil(L);
+    lua_pushstring(L, err);
+    return 2;
+  }
+  indeg = calloc(c.n + 1, sizeof(int));
+  order = malloc(c.n * sizeof(int) + 1);
+  if (!indeg || !order){
+    free(indeg); free(order);
+    csr_free(&c);
+    return pushnomem(L);
+  }
+  for (j = 0; j < c.m; j++)
+    indeg[c.col[j]]++;
+  head = tail = 0;
+  for (i = 0; i < c.n; i++)
+    if (indeg[i] == 0)
+      order[tail++] = i;
+  while (head < tail){
+    u = order[head++];
+    for (j = c.off[u]; j < c.off[u + 1]; j++)
+      if (--indeg[c.col[j]] == 0)
+        order[tail++] = c.col[j];
+  }
+  if (tail == c.n){
+    push_names(L, &c, order, c.n);
+    free(indeg); free(order);
+    csr_free(&c);
+    return 1;
+  }
+
+  /*
+   * Cycle witness: every node left over has a predecessor that is left 
+   * over too. Walking predecessors must run into a cycle.
+   */
+  if (csr_build(ud->g, NULL, CSR_REVERSE, &rc, &err) ||
+      (mark = malloc(c.n * sizeof(int) + 1)) == NULL){
+    free(indeg); free(order);
+    csr_free(&c);
+    csr_free(&rc);
+    return pushnomem(L);
+  }
+  for (i = 0; i < c.n; i++)
+    mark[i] = -1;
+  for (v = 0; indeg[v] == 0; v++)
+    ;
+  for (len = 0; mark[v] < 0; len++){
+    mark[v] = len;
+    order[len] = v;
+    for (j = rc.off[v]; indeg[rc.col[j]] == 0; j++)
+      ;
+    v = rc.col[j];
+  }
+  /* order[mark[v] .. len-1] is the cycle walked backwards */
+  for (i = mark[v], j = len - 1; i < j; i++, j--){
+    u = order[i];
+    order[i] = order[j];
+    order[j] = u;
+  }
+  lua_pushnil(L);
+  lua_pushstring(L, "graph has a cycle");
+  push_names(L, &c, order + mark[v], len - mark[v]);
+  free(indeg); free(order); free(mark);
+  csr_free(&c);
+  csr_free(&rc);
+  return 3;
+}
+
+/*
+ * Union-find with path halving.
+ */
+static int uf_find(int *parent, int v)
+{
+  while (parent[v] != v){
+    parent[v] = parent[parent[v]];
+    v = parent[v];
+  }
+  return v;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Method: t = g.components(self)
+ * Computes the connected components of a graph. Edge directions are 
+ * ignored, i.e. directed graphs yield their weakly connected components.
+ * Components are ordered by their first node in g:nodenames() order.
+ * Returns an array of components, each an array of node names, or nil 
+ * plus error message.
+ * Example:
+ * for _, comp in ipairs(g:components()) do print(#comp) end
+\*-------------------------------------------------------------------------*/
+int gr_components(lua_State *L)
+{
+  gr_csr_t c;
+  const char *err;
+  int *parent, *list, *start, *count;
+  int i, j, r, s, ngroups;
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+
+  if (csr_build(ud->g, NULL, 0, &c, &err)){
+    lua_pushnil(L);
+    lua_pushstring(L, err);
+    return 2;
+  }
+  parent = malloc(c.n * sizeof(int) + 1);
+  list = malloc(c.n * sizeof(int) + 1);
+  start = malloc((c.n + 1) * sizeof(int));
+  count = calloc(c.n + 1, sizeof(int));
+  if (!parent || !list || !start || !count){
+    free(parent); free(list); free(start); free(count);
+    csr_free(&c);
+    return pushnomem(L);
+  }
+  for (i = 0; i < c.n; i++)
+    parent[i] = i;
+  for (i = 0; i < c.n; i++)
+    for (j = c.off[i]; j < c.off[i + 1]; j++){
+      r = uf_find(parent, i);
+      s = uf_find(parent, c.col[j]);
+      /* the smaller index becomes the root */
+      if (r < s)
+        parent[s] = r;
+      else if (s < r)
+        parent[r] = s;
+    }
+
+  /* Roots are the first nodes of their components: number groups in order */
+  ngroups = 0;
+  for (i = 0; i < c.n; i++){
+    r = uf_find(parent, i);
+    if (r == i)
+      start[i] = ngroups++;
+    count[start[r]]++;
+  }
+  /* count[] -> group offsets; reuse count as insert positions */
+  for (s = 0, i = 0; i < ngroups; i++){
+    r = count[i];
+    count[i] = s;
+    s += r;
+  }
+  count[ngroups] = s;
+  for (i = 0; i < c.n; i++)
+    list[count[start[uf_find(parent, i)]]++] = i;
+  /* insert positions now hold group ends */
+  for (i = ngroups; i > 0; i--)
+    count[i] = count[i - 1];
+  count[0] = 0;
+  push_groups(L, &c, list, count, ngroups);
+  free(parent); free(list); free(start); free(count);
+  csr_free(&c);
+  return 1;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Worker pool
+\*-------------------------------------------------------------------------*/
+#ifdef USE_PTHREADS
+struct pool_worker_s {
+  gr_pool_t *pool;
+  int tid;
+};
+
+static void *pool_worker(void *p)
+{
+  struct pool_worker_s *w = (struct pool_worker_s *) p;
+  gr_pool_t *pool = w->pool;
+  int tid = w->tid;
+  unsigned long gen = 0;
+
+  free(w);
+  for (;;){
+    pthread_mutex_lock(&pool->mtx);
+    while (pool->gen == gen && !pool->quit)
+      pthread_cond_wait(&pool->go, &pool->mtx);
+    if (pool->quit){
+      pthread_mutex_unlock(&pool->mtx);
+      return NULL;
+    }
+    gen = pool->gen;
+    pthread_mutex_unlock(&pool->mtx);
+    pool->job(pool->arg, tid, pool->nthreads);
+    pthread_mutex_lock(&pool->mtx);
+    if (--pool->pending == 0)
+      pthread_cond_signal(&pool->done);
+    pthread_mutex_unlock(&pool->mtx);
+  }
+}
+#endif
+
+/*
+ * Default number of threads: number of online processors.
+ */
+static int pool_defthreads(void)
+{
+#if defined(USE_PTHREADS) && defined(_SC_NPROCESSORS_ONLN)
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return (n > 0) ? (int) n : 1;
+#else
+  return 1;
+#endif
+}
+
+/*
+ * Start a pool of nthreads threads. Without thread support, or if threads
+ * cannot be created, fewer threads are used.
+ */
+static void pool_open(gr_pool_t *pool, int nthreads)
+{
+  memset(pool, 0, sizeof(gr_pool_t));
+  if (nthreads < 1)
+    nthreads = 1;
+  if (nthreads > MAXTHREADS)
+    nthreads = MAXTHREADS;
+  pool->nthreads = 1;
+#ifdef USE_PTHREADS
+  pthread_mutex_init(&pool->mtx, NULL);
+  pthread_cond_init(&pool->go, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  while (pool->nthreads < nthreads){
+    struct pool_worker_s *w = malloc(sizeof(struct pool_worker_s));
+    if (w == NULL)
+      break;
+    w->pool = pool;
+    w->tid = pool->nthreads;
+    if (pthread_create(&pool->tids[pool->nthreads], NULL, pool_worker, w) != 0){
+      free(w);
+      break;
+    }
+    pool->nthreads++;
+  }
+#endif
+}
+
+static void pool_run(gr_pool_t *pool, pool_job_t *job, void *arg)
+{
+  pool->job = job;
+  pool->arg = arg;
+#ifdef USE_PTHREADS
+  if (pool->nthreads > 1){
+    pthread_mutex_lock(&pool->mtx);
+    pool->pending = pool->nthreads - 1;
+    pool->gen++;
+    pthread_cond_broadcast(&pool->go);
+    pthread_mutex_unlock(&pool->mtx);
+    job(arg, 0, pool->nthreads);
+    pthread_mutex_lock(&pool->mtx);
+    while (pool->pending > 0)
+      pthread_cond_wait(&pool->done, &pool->mtx);
+    pthread_mutex_unlock(&pool->mtx);
+    return;
+  }
+#endif
+  job(arg, 0, 1);
+}
+
+static void pool_close(gr_pool_t *pool)
+{
+#ifdef USE_PTHREADS
+  int i;
+
+  pthread_mutex_lock(&pool->mtx);
+  pool->quit = 1;
+  pthread_cond_broadcast(&pool->go);
+  pthread_mutex_unlock(&pool->mtx);
+  for (i = 1; i < pool->nthreads; i++)
+    pthread_join(pool->tids[i], NULL);
+  pthread_mutex_destroy(&pool->mtx);
+  pthread_cond_destroy(&pool->go);
+  pthread_cond_destroy(&pool->done);
+#endif
+}
+
+/*
+ * Range of items [*from, *to) of thread tid.
+ */
+static void pool_range(int n, int tid, int nthreads, int *from, int *to)
+{
+  *from = (int)((long long) n * tid / nthreads);
+  *to = (int)((long long) n * (tid + 1) / nthreads);
+}
+
+/*-------------------------------------------------------------------------*\
+ * Centrality
+\*-------------------------------------------------------------------------*/
+/*
+ * Option access: fields of the table at index idx.
+ */
+double optnumfield(lua_State *L, int idx, const char *name, double def)
+{
+  double v = def;
+
+  if (lua_istable(L, idx)){
+    lua_getfield(L, idx, name);
+    if (!lua_isnil(L, -1))
+      v = luaL_checknumber(L, -1);
+    lua_pop(L, 1);
+  }
+  return v;
+}
+
+const char *optstrfield(lua_State *L, int idx, const char *name)
+{
+  const char *s = NULL;
+
+  if (lua_istable(L, idx)){
+    lua_getfield(L, idx, name);
+    if (!lua_isnil(L, -1))
+      s = luaL_checkstring(L, -1);
+    lua_pop(L, 1);   /* keeps the string: it is referenced by the options table */
+  }
+  return s;
+}
+
+/*
+ * Store centrality values: into node attribute attr if given, otherwise
+ * as array in g:nodenames() order.
+ */
+static int push_values(lua_State *L, gr_csr_t *c, const double *val, const char *attr)
+{
+  Agsym_t *sym;
+  gr_numattr_t *num;
+  char buf[32];
+  int i;
+
+  if (attr == NULL){
+    lua_createtable(L, c->n, 0);
+    for (i = 0; i < c->n; i++){
+      lua_pushnumber(L, val[i]);
+      lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+  }
+  if ((num = numattr_find(c->g, AGNODE, attr)) != NULL){
+    for (i = 0; i < c->n; i++)
+      if (numattr_set(num, c->nodes[i], val[i])){
+        lua_pushnil(L);
+        lua_pushstring(L, "out of memory");
+        return 2;
+      }
+    lua_pushboolean(L, 1);
+    return 1;
+  }
+  if ((sym = agattr(agroot(c->g), AGNODE, (char *) attr, NULL)) == NULL &&
+      (sym = agattr(agroot(c->g), AGNODE, (char *) attr, "")) == NULL){
+    lua_pushnil(L);
+    lua_pushstring(L, "declaration failed");
+    return 2;
+  }
+  for (i = 0; i < c->n; i++){
+    sprintf(buf, "%.10g", val[i]);
+    agxset(c->nodes[i], sym, buf);
+  }
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+/*
+ * PageRank power iteration: pulls rank along the in-edges in rows of the
+ * reversed snapshot. Threads own disjoint ranges of nodes.
+ */
+struct pagerank_s {
+  gr_csr_t *c;            /* rows: predecessors */
+  const int *outdeg;
+  double *rank;
+  double *next;
+  double *contrib;
+  double damping;
+  double dangling;        /* rank of nodes without successors */
+  double part[MAXTHREADS];
+};
+
+static void pr_contrib(void *arg, int tid, int nthreads)
+{
+  struct pagerank_s *p = (struct pagerank_s *) arg;
+  int i, from, to;
+  double dangling = 0;
+
+  pool_range(p->c->n, tid, nthreads, &from, &to);
+  for (i = from; i < to; i++){
+    if (p->outdeg[i] == 0){
+      dangling += p->rank[i];
+      p->contrib[i] = 0;
+    } else
+      p->contrib[i] = p->rank[i] / p->outdeg[i];
+  }
+  p->part[tid] = dangling;
+}
+
+static void pr_update(void *arg, int tid, int nthreads)
+{
+  struct pagerank_s *p = (struct pagerank_s *) arg;
+  gr_csr_t *c = p->c;
+  int i, j, from, to;
+  double sum, base, diff = 0;
+
+  base = (1.0 - p->damping) / c->n + p->damping * p->dangling / c->n;
+  pool_range(c->n, tid, nthreads, &from, &to);
+  for (i = from; i < to; i++){
+    sum = 0;
+    for (j = c->off[i]; j < c->off[i + 1]; j++)
+      sum += p->contrib[c->col[j]];
+    p->next[i] = base + p->damping * sum;
+    diff += fabs(p->next[i] - p->rank[i]);
+  }
+  p->part[tid] = diff;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Method: t, niter = g.pagerank(self [, options])
+ * Computes the PageRank of all nodes. Options is a table with the fields:
+ *   damping: damping factor (default 0.85)
+ *   tol:     stop when the L1 change of an iteration is below (default 1e-6)
+ *   maxiter: maximum number of iterations (default 100)
+ *   threads: number of worker threads (default: number of processors)
+ *   attr:    store the ranks in this node attribute instead of returning
+ *            them
+ * The graph is only accessed for taking the adjacency snapshot; iterations
+ * run in parallel on the snapshot. Undirected edges count in both 
+ * directions.
+ * Returns an array of ranks in g:nodenames() order (or true if attr is 
+ * given) and the number of iterations, nil plus error message on failure.
+ * Example:
+ * rank, niter = g:pagerank{damping = 0.85, threads = 4}
+\*-------------------------------------------------------------------------*/
+int gr_pagerank(lua_State *L)
+{
+  gr_csr_t c;
+  gr_pool_t pool;
+  struct pagerank_s p;
+  const char *err;
+  double *t, diff;
+  int *outdeg, i, j, iter, rv;
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+  double damping = optnumfield(L, 2, "damping", 0.85);
+  double tol = optnumfield(L, 2, "tol", 1e-6);
+  int maxiter = (int) optnumfield(L, 2, "maxiter", 100);
+  int nthreads = (int) optnumfield(L, 2, "threads", pool_defthreads());
+  const char *attr = optstrfield(L, 2, "attr");
+
+  if (csr_build(ud->g, NULL, CSR_REVERSE, &c, &err)){
+    lua_pushnil(L);
+    lua_pushstring(L, err);
+    return 2;
+  }
+  memset(&p, 0, sizeof(p));
+  outdeg = calloc(c.n + 1, sizeof(int));
+  p.rank = malloc(c.n * sizeof(double) + 1);
+  p.next = malloc(c.n * sizeof(double) + 1);
+  p.contrib = malloc(c.n * sizeof(double) + 1);
+  if (!outdeg || !p.rank || !p.next || !p.contrib){
+    free(outdeg); free(p.rank); free(p.next); free(p.contrib);
+    csr_free(&c);
+    return pushnomem(L);
+  }
+  /* Rows hold predecessors: a node's out-degree is its count in col */
+  for (j = 0; j < c.m; j++)
+    outdeg[c.col[j]]++;
+  for (i = 0; i < c.n; i++)
+    p.rank[i] = 1.0 / c.n;
+  p.c = &c;
+  p.outdeg = outdeg;
+  p.damping = damping;
+  if (nthreads > c.n / 1024 + 1)
+    nthreads = c.n / 1024 + 1;
+  pool_open(&pool, nthreads);
+  for (iter = 0; iter < maxiter && c.n > 0;){
+    pool_run(&pool, pr_contrib, &p);
+    for (p.dangling = 0, i = 0; i < pool.nthreads; i++)
+      p.dangling += p.part[i];
+    pool_run(&pool, pr_update, &p);
+    for (diff = 0, i = 0; i < pool.nthreads; i++)
+      diff += p.part[i];
+    t = p.rank; p.rank = p.next; p.next = t;
+    iter++;
+    if (diff < tol)
+      break;
+  }
+  pool_close(&pool);
+  rv = push_values(L, &c, p.rank, attr);
+  if (rv == 1){
+    lua_pushnumber(L, iter);
+    rv = 2;
+  }
+  free(outdeg); free(p.rank); free(p.next); free(p.contrib);
+  csr_free(&c);
+  return rv;
+}
+
+/*
+ * Brandes' betweenness centrality for unweighted graphs. Threads take 
+ * every nthreads-th source and accumulate into private score arrays.
+ */
+struct betweenness_s {
+  gr_csr_t *c;
+  double *score[MAXTHREADS];
+  int error;
+};
+
+static void bc_sources(void *arg, int tid, int nthreads)
+{
+  struct betweenness_s *b = (struct betweenness_s *) arg;
+  gr_csr_t *c = b->c;
+  int n = c->n;
+  int *dist, *order;
+  double *sigma, *delta, *score;
+  int s, i, j, u, v, head, tail;
+
+  dist = malloc(n * sizeof(int) + 1);
+  order = malloc(n * sizeof(int) + 1);
+  sigma = malloc(n * sizeof(double) + 1);
+  delta = malloc(n * sizeof(double) + 1);
+  score = calloc(n + 1, sizeof(double));
+  if (!dist || !order || !sigma || !delta || !score){
+    free(dist); free(order); free(sigma); free(delta); free(score);
+    b->error = 1;
+    return;
+  }
+  for (i = 0; i < n; i++)
+    dist[i] = -1;
+  for (s = tid; s < n; s += nthreads){
+    /* BFS from s: order[] holds the nodes in non-decreasing distance */
+    dist[s] = 0;
+    sigma[s] = 1;
+    order[0] = s;
+    head = 0;
+    tail = 1;
+    while (head < tail){
+      u = order[head++];
+      delta[u] = 0;
+      for (j = c->off[u]; j < c->off[u + 1]; j++){
+        v = c->col[j];
+        if (dist[v] < 0){
+          dist[v] = dist[u] + 1;
+          sigma[v] = 0;
+          order[tail++] = v;
+        }
+        if (dist[v] == dist[u] + 1)
+          sigma[v] += sigma[u];
+      }
+    }
+    /* Accumulate dependencies in reverse BFS order */
+    for (i = tail - 1; i >= 0; i--){
+      u = order[i];
+      for (j = c->off[u]; j < c->off[u + 1]; j++){
+        v = c->col[j];
+        if (dist[v] == dist[u] + 1)
+          delta[u] += sigma[u] / sigma[v] * (1 + delta[v]);
+      }
+      if (u != s)
+        score[u] += delta[u];
+    }
+    for (i = 0; i < tail; i++)
+      dist[order[i]] = -1;
+  }
+  b->score[tid] = score;
+  free(dist); free(order); free(sigma); free(delta);
+}
+
+/*-------------------------------------------------------------------------*\
+ * Method: t = g.betweenness(self [, options])
+ * Computes the betweenness centrality of all nodes with Brandes' 
+ * algorithm; edges are unweighted. Options is a table with the fields:
+ *   normalized: divide by the number of node pairs not containing the
+ *               node, (n-1)(n-2) for directed and (n-1)(n-2)/2 for
+ *               undirected graphs, so that values lie in [0, 1]
+ *               (default false)
+ *   threads:    number of worker threads (default: number of processors)
+ *   attr:       store the values in this node attribute instead of 
+ *               returning them
+ * Returns an array of values in g:nodenames() order (or true if attr is 
+ * given), nil plus error message on failure.
+ * Example:
+ * bc = g:betweenness{normalized = true}
+\*-------------------------------------------------------------------------*/
+int gr_betweenness(lua_State *L)
+{
+  gr_csr_t c;
+  gr_pool_t pool;
+  struct betweenness_s b;
+  const char *err;
+  double *score, scale;
+  int i, t, rv;
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+  int normalized = 0;
+  int nthreads = (int) optnumfield(L, 2, "threads", pool_defthreads());
+  const char *attr = optstrfield(L, 2, "attr");
+
+  if (lua_istable(L, 2)){
+    lua_getfield(L, 2, "normalized");
+    normalized = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+  }
+  if (csr_build(ud->g, NULL, 0, &c, &err)){
+    lua_pushnil(L);
+    lua_pushstring(L, err);
+    return 2;
+  }
+  memset(&b, 0, sizeof(b));
+  b.c = &c;
+  if (nthreads > c.n)
+    nthreads = c.n;
+  pool_open(&pool, nthreads);
+  pool_run(&pool, bc_sources, &b);
+  pool_close(&pool);
+  score = b.score[0];
+  if (b.error || score == NULL){
+    for (t = 0; t < pool.nthreads; t++)
+      free(b.score[t]);
+    csr_free(&c);
+    return pushnomem(L);
+  }
+  for (t = 1; t < pool.nthreads; t++){
+    for (i = 0; i < c.n; i++)
+      score[i] += b.score[t][i];
+    free(b.score[t]);
+  }
+  /* Undirected graphs count every pair in both directions */
+  if (normalized && c.n > 2)
+    scale = 1.0 / ((double)(c.n - 1) * (c.n - 2));
+  else
+    scale = agisdirected(c.g) ? 1.0 : 0.5;
+  for (i = 0; i < c.n; i++)
+    score[i] *= scale;
+  rv = push_values(L, &c, score, attr);
+  free(score);
+  csr_free(&c);
+  return rv;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Method: off, col [, w] = g.csr(self [, weightattr])
+ * Retrieves the adjacency of a graph as compressed sparse rows. Nodes are
+ * numbered 1..N in the order of g:nodenames(). The successors of node i
+ * are col[off[i]] .. col[off[i+1]-1]; undirected graphs list every edge
+ * for both end nodes. If weightattr is given, w holds the numeric value of
+ * this edge attribute for each entry of col; empty values count as 1.
+ * Returns three arrays on success, nil plus error message on failure.
+ * Example:
+ * off, col, w = g:csr("weight")
+\*-------------------------------------------------------------------------*/
+int gr_csr(lua_State *L)
+{
+  gr_csr_t c;
+  const char *err;
+  int i;
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+  const char *wattr = luaL_optstring(L, 2, NULL);
+
+  if (csr_build(ud->g, wattr, 0, &c, &err)){
+    lua_pushnil(L);
+    lua_pushstring(L, err);
+    return 2;
+  }
+  push_intarray(L, c.off, c.n + 1, 1);                /* ud, [w,] off */
+  push_intarray(L, c.col, c.m, 1);                    /* ud, [w,] off, col */
+  if (c.w == NULL){
+    csr_free(&c);
+    return 2;
+  }
+  lua_createtable(L, c.m, 0);                         /* ud, w, off, col, wt */
+  for (i = 0; i < c.m; i++){
+    lua_pushnumber(L, c.w[i]);
+    lua_rawseti(L, -2, i + 1);
+  }
+  csr_free(&c);
+  return 3;
+}
@@ -0,0 +1,436 @@
+/*=========================================================================*\
+ * LuaGRAPH toolkit
+ * Graph support for Lua.
+ * Herbert Leuwer
+ * 30-7-2006, 01/2017
+ *
+ * Background layout on a worker thread.
+ *
+\*=========================================================================*/
+
+/*=========================================================================*\
+ * Includes
+\*=========================================================================*/
+#include <string.h>
+#include <stdlib.h>
+#ifdef USE_PTHREADS
+#include <pthread.h>
+#endif
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "gr_graph.h"
+
+/*=========================================================================*\
+ * Defines
+\*=========================================================================*/
+#define ASYNC_HANDLE "graph.async"
+
+/*=========================================================================*\
+ * Data
+\*=========================================================================*/
+/*
+ * Background layout, shared by the handle and the worker. A worker whose
+ * handle has been collected is detached and frees the job itself.
+ */
+struct gr_job_s {
+  Agraph_t *g;
+  GVC_t *gvc;
+  char engine[16];
+  int rv;                   /* result of gvLayout() */
+  int done;                 /* worker has finished */
+  int cancel;               /* result is discarded */
+  int detached;             /* handle is gone */
+#ifdef USE_PTHREADS
+  pthread_t thread;
+  pthread_mutex_t mtx;
+  pthread_cond_t cond;
+#endif
+};
+typedef struct gr_job_s gr_job_t;
+
+/*
+ * Handle of a background layout.
+ */
+struct gr_async_s {
+  gr_job_t *job;
+  int ref;                  /* registry reference to the graph userdata */
+  int rv;                   /* result of gvLayout() */
+  int cancel;               /* result is discarded */
+  int finished;             /* job released, graph given back */
+};
+typedef struct gr_async_s gr_async_t;
+
+/*
+ * Graphviz context of background layouts. Like the context of the Lua
+ * thread it lives as long as the process: layout results refer to it.
+ */
+static GVC_t *bgvc = NULL;
+
+/*
+ * Root graphs with a background layout: no Lua access until finished.
+ * The list is shared by all Lua states of the process.
+ */
+static Agraph_t **busy = NULL;
+static int nbusy = 0;
+static int maxbusy = 0;
+
+#ifdef USE_PTHREADS
+/* Graphviz keeps global state: layouts and rendering are serialized */
+static pthread_mutex_t gvmtx = PTHREAD_MUTEX_INITIALIZER;
+/* Guards the busy list; not gvmtx, which is held during layouts */
+static pthread_mutex_t busymtx = PTHREAD_MUTEX_INITIALIZER;
+#define busy_lock() pthread_mutex_lock(&busymtx)
+#define busy_unlock() pthread_mutex_unlock(&busymtx)
+#else
+#define busy_lock()
+#define busy_unlock()
+#endif
+
+static int async_done(lua_State *L);
+static int async_wait(lua_State *L);
+static int async_cancel(lua_State *L);
+static int async_collect(lua_State *L);
+
+static const luaL_Reg reg_async_methods[] = {
+  {"done", async_done},
+  {"wait", async_wait},
+  {"cancel", async_cancel},
+  {"__gc", async_collect},
+  {NULL, NULL}
+};
+
+/*=========================================================================*\
+ * Functions
+\*=========================================================================*/
+/*-------------------------------------------------------------------------*\
+ * Serialization of Graphviz calls
+\*-------------------------------------------------------------------------*/
+void gv_lock(void)
+{
+#ifdef USE_PTHREADS
+  pthread_mutex_lock(&gvmtx);
+#endif
+}
+
+void gv_unlock(void)
+{
+#ifdef USE_PTHREADS
+  pthread_mutex_unlock(&gvmtx);
+#endif
+}
+
+/*-------------------------------------------------------------------------*\
+ * Busy graphs
+\*-------------------------------------------------------------------------*/
+/*
+ * Check whether the root graph of obj has a background layout running.
+ */
+int async_busy(void *obj)
+{
+  Agraph_t *root = agroot(obj);
+  int i, rv = 0;
+
+  busy_lock();
+  for (i = 0; i < nbusy && !rv; i++)
+    rv = (busy[i] == root);
+  busy_unlock();
+  return rv;
+}
+
+static int busy_add(Agraph_t *root)
+{
+  Agraph_t **p;
+  int rv = 0;
+
+  busy_lock();
+  if (nbusy == maxbusy){
+    if ((p = realloc(busy, (maxbusy + 8) * sizeof(Agraph_t *))) == NULL)
+      rv = -1;
+    else {
+      busy = p;
+      maxbusy += 8;
+    }
+  }
+  if (rv == 0)
+    busy[nbusy++] = root;
+  busy_unlock();
+  return rv;
+}
+
+static void busy_del(Agraph_t *root)
+{
+  int i;
+
+  busy_lock();
+  for (i = 0; i < nbusy; i++)
+    if (busy[i] == root){
+      busy[i] = busy[--nbusy];
+      break;
+    }
+  busy_unlock();
+}
+
+/*-------------------------------------------------------------------------*\
+ * Worker
+\*-------------------------------------------------------------------------*/
+/*
+ * Give the graph of a finished job back and free the job. The layout of a
+ * cancelled run is freed.
+ */
+static void job_release(gr_job_t *job)
+{
+  busy_del(agroot(job->g));
+  if (job->cancel && job->rv == 0){
+    gv_lock();
+    gvFreeLayout(job->gvc, job->g);
+    gv_unlock();
+  }
+#ifdef USE_PTHREADS
+  pthread_mutex_destroy(&job->mtx);
+  pthread_cond_destroy(&job->cond);
+#endif
+  free(job);
+}
+
+#ifdef USE_PTHREADS
+static void *async_worker(void *arg)
+{
+  gr_job_t *job = (gr_job_t *) arg;
+  int cancel, detached, rv = -1;
+
+  gv_lock();
+  pthread_mutex_lock(&job->mtx);
+  cancel = job->cancel;
+  pthread_mutex_unlock(&job->mtx);
+  if (!cancel)
+    rv = gvLayout(job->gvc, job->g, job->engine);
+  gv_unlock();
+  pthread_mutex_lock(&job->mtx);
+  job->rv = rv;
+  job->done = 1;
+  detached = job->detached;
+  pthread_cond_broadcast(&job->cond);
+  pthread_mutex_unlock(&job->mtx);
+  if (detached)
+    job_release(job);
+  return NULL;
+}
+#endif
+
+static int isdone(gr_async_t *h)
+{
+  int done;
+#ifdef USE_PTHREADS
+  if (h->finished)
+    return 1;
+  pthread_mutex_lock(&h->job->mtx);
+  done = h->job->done;
+  pthread_mutex_unlock(&h->job->mtx);
+#else
+  done = h->finished || h->job->done;
+#endif
+  return done;
+}
+
+/*
+ * Join the finished worker and give the graph back to Lua.
+ */
+static void async_finish(lua_State *L, gr_async_t *h)
+{
+  if (h->finished)
+    return;
+#ifdef USE_PTHREADS
+  pthread_join(h->job->thread, NULL);
+#endif
+  h->rv = h->job->rv;
+  h->job->cancel = h->cancel;
+  job_release(h->job);
+  h->job = NULL;
+  luaL_unref(L, LUA_REGISTRYINDEX, h->ref);
+  h->finished = 1;
+}
+
+static int pushresult(lua_State *L, gr_async_t *h)
+{
+  if (h->cancel){
+    lua_pushnil(L);
+    lua_pushstring(L, "layout cancelled");
+    return 2;
+  }
+  if (h->rv != 0){
+    lua_pushnil(L);
+    lua_pushstring(L, "layout error");
+    return 2;
+  }
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Method: h, err = g.layout_async(self, engine)
+ * Layout the given graph on a worker thread with its own Graphviz context.
+ * The graph and its nodes and edges cannot be used until the handle reports
+ * completion. Only the calling Lua thread is freed, for work that does not
+ * involve Graphviz: Graphviz is not thread safe, so the background layout
+ * holds the global Graphviz lock until it has finished, and any layout or
+ * rendering meanwhile waits for it. Without thread support the layout runs
+ * immediately. Collecting an unfinished handle cancels the layout without
+ * waiting for it; the graph stays busy until the worker has finished.
+ * Returns a handle on success, nil plus error message otherwise.
+ * Handle methods:
+ *   h:done()   - true if the layout has finished, never blocks
+ *   h:wait()   - waits for the layout; returns true or nil plus error
+ *   h:cancel() - discards the result; a queued layout does not run at all
+ * Example:
+ * h = g:layout_async("dot")
+ * while not h:done() do coroutine.yield() end
+ * assert(h:wait())
+ * g:render("png", "out.png")
+\*-------------------------------------------------------------------------*/
+int gr_layout_async(lua_State *L)
+{
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+  const char *engine = luaL_optstring(L, 2, "dot");
+  gr_async_t *h;
+  gr_job_t *job;
+
+  if (!gv_isengine(engine))
+    return luaL_error(L, "invalid layout format '%s'", engine);
+  gv_lock();
+  if (bgvc == NULL)
+    bgvc = gv_context();
+  gv_unlock();
+  if (bgvc == NULL){
+    lua_pushnil(L);
+    lua_pushstring(L, "cannot create context");
+    return 2;
+  }
+  numattr_sync(ud->g);
+  h = (gr_async_t *) lua_newuserdata(L, sizeof(gr_async_t));  /* ud, [engine], h */
+  memset(h, 0, sizeof(gr_async_t));
+  h->ref = LUA_NOREF;
+  h->finished = 1;
+  if (luaL_newmetatable(L, ASYNC_HANDLE)){                  /* ud, [engine], h, mt */
+    register_metainfo(L, reg_async_methods);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+  }
+  lua_setmetatable(L, -2);                                  /* ud, [engine], h */
+  if ((job = (gr_job_t *) calloc(1, sizeof(gr_job_t))) == NULL){
+    lua_pushnil(L);
+    lua_pushstring(L, "out of memory");
+    return 2;
+  }
+  job->g = ud->g;
+  job->gvc = bgvc;
+  strcpy(job->engine, engine);
+#ifdef USE_PTHREADS
+  if (busy_add(agroot(job->g))){
+    free(job);
+    lua_pushnil(L);
+    lua_pushstring(L, "out of memory");
+    return 2;
+  }
+  pthread_mutex_init(&job->mtx, NULL);
+  pthread_cond_init(&job->cond, NULL);
+  if (pthread_create(&job->thread, NULL, async_worker, job) != 0){
+    job_release(job);
+    lua_pushnil(L);
+    lua_pushstring(L, "cannot create thread");
+    return 2;
+  }
+  lua_pushvalue(L, 1);                                      /* ud, [engine], h, ud */
+  h->ref = luaL_ref(L, LUA_REGISTRYINDEX);                  /* ud, [engine], h */
+#else
+  job->rv = gvLayout(job->gvc, job->g, job->engine);
+  job->done = 1;
+#endif
+  h->job = job;
+  h->finished = 0;
+  return 1;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Handle methods
+\*-------------------------------------------------------------------------*/
+static int async_done(lua_State *L)
+{
+  gr_async_t *h = (gr_async_t *) luaL_checkudata(L, 1, ASYNC_HANDLE);
+
+  if (!isdone(h)){
+    lua_pushboolean(L, 0);
+    return 1;
+  }
+  async_finish(L, h);
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+static int async_wait(lua_State *L)
+{
+  gr_async_t *h = (gr_async_t *) luaL_checkudata(L, 1, ASYNC_HANDLE);
+
+#ifdef USE_PTHREADS
+  if (!h->finished){
+    pthread_mutex_lock(&h->job->mtx);
+    while (!h->job->done)
+      pthread_cond_wait(&h->job->cond, &h->job->mtx);
+    pthread_mutex_unlock(&h->job->mtx);
+  }
+#endif
+  async_finish(L, h);
+  return pushresult(L, h);
+}
+
+static int async_cancel(lua_State *L)
+{
+  gr_async_t *h = (gr_async_t *) luaL_checkudata(L, 1, ASYNC_HANDLE);
+
+  if (h->finished && !h->cancel){
+    /* result already delivered */
+    lua_pushboolean(L, 0);
+    return 1;
+  }
+#ifdef USE_PTHREADS
+  if (!h->finished){
+    pthread_mutex_lock(&h->job->mtx);
+    h->job->cancel = 1;
+    pthread_mutex_unlock(&h->job->mtx);
+  }
+#endif
+  h->cancel = 1;
+  if (isdone(h))
+    async_finish(L, h);
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+/*
+ * An unfinished layout is cancelled and its worker detached: the worker
+ * frees the job and gives the graph back when it has finished.
+ */
+static int async_collect(lua_State *L)
+{
+  gr_async_t *h = (gr_async_t *) lua_touserdata(L, 1);
+
+  if (h->finished)
+    return 0;
+#ifdef USE_PTHREADS
+  pthread_mutex_lock(&h->job->mtx);
+  if (!h->job->done){
+    h->job->cancel = 1;
+    h->job->detached = 1;
+    pthread_detach(h->job->thread);
+    pthread_mutex_unlock(&h->job->mtx);
+    h->job = NULL;
+    luaL_unref(L, LUA_REGISTRYINDEX, h->ref);
+    h->finished = 1;
+    return 0;
+  }
+  pthread_mutex_unlock(&h->job->mtx);
+#endif
+  async_finish(L, h);
+  return 0;
+}
@@ -0,0 +1,705 @@
+/*=========================================================================*\
+ * LuaGRAPH toolkit
+ * Graph support for Lua.
+ * Herbert Leuwer
+ * 30-7-2006, 01/2017
+ *
+ * Attribute access without name lookup, attribute columns and numeric
+ * attributes.
+ *
+\*=========================================================================*/
+
+/*=========================================================================*\
+ * Includes
+\*=========================================================================*/
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "gr_graph.h"
+
+/*=========================================================================*\
+ * Defines
+\*=========================================================================*/
+#define ATTRSYM_HANDLE "graph.attrsym"
+#define NUMATTR_REC "luagraph_numattrs"
+
+/*=========================================================================*\
+ * Data
+\*=========================================================================*/
+/*
+ * Attribute symbol handle. Keeps a reference to the root graph proxy,
+ * whose status tells whether the symbol is still valid.
+ */
+struct gr_attrsym_s {
+  Agraph_t *root;
+  Agsym_t *sym;
+  int kind;
+  gr_graph_t *gud;
+  int ref;
+};
+typedef struct gr_attrsym_s gr_attrsym_t;
+
+/*
+ * Numeric attribute: values of all nodes or edges of a root graph,
+ * indexed by sequence number.
+ */
+union gr_numval_u {
+  double d;
+  long long i;
+};
+typedef union gr_numval_u gr_numval_t;
+
+struct gr_numattr_s {
+  int kind;
+  int isint;
+  char *name;
+  gr_numval_t *val;
+  unsigned char *isset;
+  size_t size;
+  int dirty;                /* string values are out of date */
+  struct gr_numattr_s *next;
+};
+
+/*
+ * Numeric attributes of a root graph, kept in a cgraph record of the root.
+ * Only the Lua state owning the graph touches them, so no lock is needed.
+ */
+struct gr_numrec_s {
+  Agrec_t h;
+  gr_numattr_t *first;
+};
+typedef struct gr_numrec_s gr_numrec_t;
+
+static void numattr_push(lua_State *L, gr_numattr_t *a, void *obj);
+static int attrsym_get(lua_State *L);
+static int attrsym_set(lua_State *L);
+static int attrsym_tostring(lua_State *L);
+static int attrsym_collect(lua_State *L);
+
+static const luaL_Reg reg_attrsym_methods[] = {
+  {"get", attrsym_get},
+  {"set", attrsym_set},
+  {"__tostring", attrsym_tostring},
+  {"__gc", attrsym_collect},
+  {NULL, NULL}
+};
+
+/*=========================================================================*\
+ * Functions
+\*=========================================================================*/
+/*
+ * Convert an object kind name into a cgraph kind.
+ */
+int tokind(lua_State *L, int narg)
+{
+  static const char *kinds[] = {"graph", "node", "edge", NULL};
+  static const int agkinds[] = {AGRAPH, AGNODE, AGEDGE};
+
+  return agkinds[luaL_checkoption(L, narg, NULL, kinds)];
+}
+
+static const char *kindname(int kind)
+{
+  return (kind == AGRAPH) ? "graph" : (kind == AGNODE) ? "node" : "edge";
+}
+
+/*
+ * Check the handle at narg and the object at narg + 1.
+ */
+static void *checkobj(lua_State *L, int narg, gr_attrsym_t **hp)
+{
+  gr_attrsym_t *h = (gr_attrsym_t *) luaL_checkudata(L, narg, ATTRSYM_HANDLE);
+  gr_object_t *ud = toobject(L, narg + 1, NULL, STRICT);
+
+  if (h->gud->status != ALIVE)
+    luaL_error(L, "bad argument #%d (attribute of closed graph)", narg);
+  if (ud->p.type != h->kind || agroot(ud->p.p) != h->root)
+    luaL_error(L, "bad argument #%d (%s of graph '%s' expected)", narg + 1,
+               kindname(h->kind), agnameof(h->root));
+  *hp = h;
+  return ud->p.p;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Method: h, err = g.attrsym(self, kind, name [, default])
+ * Retrieve a handle for attribute 'name' of objects of the given kind
+ * ("graph", "node" or "edge"). The handle's methods read and write the
+ * attribute without name lookup, which speeds up loops over many objects:
+ *   h:get(obj)      - returns the value or nil if empty
+ *   h:set(obj, val) - sets the value
+ * If the attribute is not declared yet, it is declared with the given
+ * default; without default nil plus error message is returned.
+ * Example:
+ * h = g:attrsym("node", "color", "black")
+ * for n in g:walknodes() do h:set(n, "red") end
+\*-------------------------------------------------------------------------*/
+int gr_attrsym(lua_State *L)
+{
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+  int kind = tokind(L, 2);
+  char *name = (char *) luaL_checkstring(L, 3);
+  char *def = (char *) luaL_optstring(L, 4, NULL);
+  Agraph_t *root = agroot(ud->g);
+  Agsym_t *sym;
+  gr_attrsym_t *h;
+
+  if (numattr_find(root, kind, name) != NULL){
+    lua_pushnil(L);
+    lua_pushfstring(L, "%s attribute '%s' is numeric", kindname(kind), name);
+    return 2;
+  }
+  if ((sym = agattr(root, kind, name, NULL)) == NULL){
+    if (def == NULL){
+      lua_pushnil(L);
+      lua_pushfstring(L, "%s attribute '%s' not declared", kindname(kind), name);
+      return 2;
+    }
+    if ((sym = agattr(root, kind, name, def)) == NULL){
+      lua_pushnil(L);
+      lua_pushstring(L, "declaration failed");
+      return 2;
+    }
+  }
+  push_object(L, root);                                 /* ..., rud */
+  h = (gr_attrsym_t *) lua_newuserdata(L, sizeof(gr_attrsym_t)); /* ..., rud, h */
+  h->root = root;
+  h->sym = sym;
+  h->kind = kind;
+  h->gud = (gr_graph_t *) lua_touserdata(L, -2);
+  lua_pushvalue(L, -2);                                 /* ..., rud, h, rud */
+  h->ref = luaL_ref(L, LUA_REGISTRYINDEX);              /* ..., rud, h */
+  if (luaL_newmetatable(L, ATTRSYM_HANDLE)){            /* ..., rud, h, mt */
+    register_metainfo(L, reg_attrsym_methods);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+  }
+  lua_setmetatable(L, -2);                              /* ..., rud, h */
+  return 1;
+}
+
+static int attrsym_get(lua_State *L)
+{
+  gr_attrsym_t *h;
+  void *obj = checkobj(L, 1, &h);
+  char *value = agxget(obj, h->sym);
+
+  if (value == NULL || *value == '\0')
+    lua_pushnil(L);
+  else
+    lua_pushstring(L, value);
+  return 1;
+}
+
+static int attrsym_set(lua_State *L)
+{
+  gr_attrsym_t *h;
+  void *obj = checkobj(L, 1, &h);
+
+  agxset(obj, h->sym, (char *) luaL_checkstring(L, 3));
+  return 0;
+}
+
+static int attrsym_tostring(lua_State *L)
+{
+  gr_attrsym_t *h = (gr_attrsym_t *) luaL_checkudata(L, 1, ATTRSYM_HANDLE);
+
+  lua_pushfstring(L, "attrsym: %p (%s %s)", h, kindname(h->kind),
+                  h->gud->status == ALIVE ? h->sym->name : "dead");
+  return 1;
+}
+
+static int attrsym_collect(lua_State *L)
+{
+  gr_attrsym_t *h = (gr_attrsym_t *) lua_touserdata(L, 1);
+
+  luaL_unref(L, LUA_REGISTRYINDEX, h->ref);
+  return 0;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Columns
+\*-------------------------------------------------------------------------*/
+static int colkind(lua_State *L, int narg)
+{
+  static const char *kinds[] = {"node", "edge", NULL};
+
+  return (luaL_checkoption(L, narg, NULL, kinds) == 0) ? AGNODE : AGEDGE;
+}
+
+/*
+ * Push one value of a column: a number or nil for numeric attributes.
+ */
+static void pushcell(lua_State *L, void *obj, Agsym_t *sym, gr_numattr_t *a)
+{
+  if (a != NULL)
+    numattr_push(L, a, obj);
+  else
+    lua_pushstring(L, agxget(obj, sym));
+}
+
+/*-------------------------------------------------------------------------*\
+ * Method: t, err = g.getcolumn(self, kind, name)
+ * Read attribute 'name' of all nodes or edges (kind "node" or "edge") of
+ * the graph in one call. Nodes are ordered as in g:nodenames(), edges by
+ * tail node in this order, then by creation. Unset values are empty
+ * strings, or nil for numeric attributes (see g:declare_numeric()).
+ * Returns the array of values on success, nil plus error message if the
+ * attribute is not declared.
+ * Example:
+ * colors = g:getcolumn("node", "color")
+\*-------------------------------------------------------------------------*/
+int gr_getcolumn(lua_State *L)
+{
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+  int kind = colkind(L, 2);
+  char *name = (char *) luaL_checkstring(L, 3);
+  Agsym_t *sym = agattr(agroot(ud->g), kind, name, NULL);
+  gr_numattr_t *a = numattr_find(ud->g, kind, name);
+  Agnode_t *n;
+  Agedge_t *e;
+  int i = 1;
+
+  if (sym == NULL && a == NULL){
+    lua_pushnil(L);
+    lua_pushfstring(L, "%s attribute '%s' not declared", kindname(kind), name);
+    return 2;
+  }
+  lua_createtable(L, (kind == AGNODE) ? agnnodes(ud->g) : agnedges(ud->g), 0);
+  for (n = agfstnode(ud->g); n; n = agnxtnode(ud->g, n)){
+    if (kind == AGNODE){
+      pushcell(L, n, sym, a);
+      lua_rawseti(L, -2, i++);
+    } else
+      for (e = agfstout(ud->g, n); e; e = agnxtout(ud->g, e)){
+        pushcell(L, e, sym, a);
+        lua_rawseti(L, -2, i++);
+      }
+  }
+  return 1;
+}
+
+/*
+ * Set one value of a column from values[i]; nil leaves the value unchanged.
+ */
+static int setcell(lua_State *L, void *obj, Agsym_t *sym, gr_numattr_t *a, int i)
+{
+  const char *v;
+
+  lua_rawgeti(L, 4, i);
+  if (lua_isnil(L, -1)){
+    lua_pop(L, 1);
+    return 0;
+  }
+  if (a != NULL){
+    numattr_store(L, a, obj, -1);
+    lua_pop(L, 1);
+    return 1;
+  }
+  if ((v = lua_tostring(L, -1)) == NULL)
+    luaL_error(L, "bad argument #4 (string or number expected at index %d)", i);
+  agxset(obj, sym, (char *) v);
+  lua_pop(L, 1);
+  return 1;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Method: count, err = g.setcolumn(self, kind, name, values)
+ * Write attribute 'name' of all nodes or edges (kind "node" or "edge") of
+ * the graph in one call. values is an array of strings or numbers in the
+ * order of g:getcolumn(); nil entries leave the value unchanged. Numeric
+ * attributes take numbers only. The attribute is declared with an empty
+ * default if necessary.
+ * Returns the number of values set on success, nil plus error message if
+ * there are more values than objects.
+ * Example:
+ * g:setcolumn("node", "fillcolor", colors)
+\*-------------------------------------------------------------------------*/
+int gr_setcolumn(lua_State *L)
+{
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+  int kind = colkind(L, 2);
+  char *name = (char *) luaL_checkstring(L, 3);
+  Agraph_t *root = agroot(ud->g);
+  Agsym_t *sym = NULL;
+  gr_numattr_t *a = numattr_find(root, kind, name);
+  Agnode_t *n;
+  Agedge_t *e;
+  int i = 1, count = 0, size;
+
+  luaL_checktype(L, 4, LUA_TTABLE);
+  lua_settop(L, 4);
+  size = (kind == AGNODE) ? agnnodes(ud->g) : agnedges(ud->g);
+  if ((int) lua_rawlen(L, 4) > size){
+    lua_pushnil(L);
+    lua_pushfstring(L, "too many values: %d %ss", size, kindname(kind));
+    return 2;
+  }
+  if (a == NULL &&
+      (sym = agattr(root, kind, name, NULL)) == NULL &&
+      (sym = agattr(root, kind, name, "")) == NULL){
+    lua_pushnil(L);
+    lua_pushstring(L, "declaration failed");
+    return 2;
+  }
+  for (n = agfstnode(ud->g); n; n = agnxtnode(ud->g, n)){
+    if (kind == AGNODE)
+      count += setcell(L, n, sym, a, i++);
+    else
+      for (e = agfstout(ud->g, n); e; e = agnxtout(ud->g, e))
+        count += setcell(L, e, sym, a, i++);
+  }
+  lua_pushnumber(L, count);
+  return 1;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Numeric attributes
+\*-------------------------------------------------------------------------*/
+/*
+ * Kind of a cgraph object: both edge halves are AGEDGE.
+ */
+static int objkind(void *obj)
+{
+  return (AGTYPE(obj) == AGINEDGE) ? AGEDGE : AGTYPE(obj);
+}
+
+/*
+ * First numeric attribute of the root of obj or NULL.
+ */
+static gr_numattr_t *numattr_first(void *obj)
+{
+  gr_numrec_t *r = (gr_numrec_t *) aggetrec(agroot(obj), NUMATTR_REC, 0);
+
+  return (r != NULL) ? r->first : NULL;
+}
+
+gr_numattr_t *numattr_find(void *obj, int kind, const char *name)
+{
+  gr_numattr_t *a;
+
+  for (a = numattr_first(obj); a; a = a->next)
+    if (a->kind == kind && !strcmp(a->name, name))
+      break;
+  return a;
+}
+
+/*
+ * Get the value of obj. Returns 1 if set, 0 otherwise.
+ */
+int numattr_get(gr_numattr_t *a, void *obj, double *v)
+{
+  size_t seq = AGSEQ(obj);
+
+  if (seq >= a->size || !a->isset[seq])
+    return 0;
+  *v = a->isint ? (double) a->val[seq].i : a->val[seq].d;
+  return 1;
+}
+
+/*
+ * Make room for sequence number seq.
+ */
+static int numattr_grow(gr_numattr_t *a, size_t seq)
+{
+  size_t size = a->size;
+  gr_numval_t *val;
+  unsigned char *isset;
+
+  if (seq < size)
+    return 0;
+  while (size <= seq)
+    size = (size == 0) ? 64 : 2 * size;
+  if ((val = realloc(a->val, size * sizeof(gr_numval_t))) == NULL)
+    return -1;
+  a->val = val;
+  if ((isset = realloc(a->isset, size)) == NULL)
+    return -1;
+  memset(isset + a->size, 0, size - a->size);
+  a->isset = isset;
+  a->size = size;
+  return 0;
+}
+
+/*
+ * Set the value of obj. Returns 0 on success, -1 if out of memory.
+ */
+int numattr_set(gr_numattr_t *a, void *obj, double v)
+{
+  size_t seq = AGSEQ(obj);
+
+  if (numattr_grow(a, seq))
+    return -1;
+  if (a->isint)
+    a->val[seq].i = (long long) v;
+  else
+    a->val[seq].d = v;
+  a->isset[seq] = 1;
+  a->dirty = 1;
+  return 0;
+}
+
+static void numattr_unset(gr_numattr_t *a, void *obj)
+{
+  size_t seq = AGSEQ(obj);
+
+  if (seq < a->size && a->isset[seq]){
+    a->isset[seq] = 0;
+    a->dirty = 1;
+  }
+}
+
+/*
+ * Push the value of obj or nil.
+ */
+static void numattr_push(lua_State *L, gr_numattr_t *a, void *obj)
+{
+  size_t seq = AGSEQ(obj);
+
+  if (seq >= a->size || !a->isset[seq])
+    lua_pushnil(L);
+  else if (a->isint)
+#if LUA_VERSION_NUM >= 503
+    lua_pushinteger(L, (lua_Integer) a->val[seq].i);
+#else
+    lua_pushnumber(L, (lua_Number) a->val[seq].i);
+#endif
+  else
+    lua_pushnumber(L, a->val[seq].d);
+}
+
+/*
+ * Store the value at idx for obj: a number, a numeric string or nil.
+ * Raises an error for other values.
+ */
+void numattr_store(lua_State *L, gr_numattr_t *a, void *obj, int idx)
+{
+  double v;
+
+  if (lua_isnil(L, idx)){
+    numattr_unset(a, obj);
+    return;
+  }
+  if (!lua_isnumber(L, idx))
+    luaL_error(L, "number expected for attribute '%s'", a->name);
+#if LUA_VERSION_NUM >= 503
+  if (a->isint && lua_isinteger(L, idx)){
+    if (numattr_grow(a, AGSEQ(obj)))
+      luaL_error(L, "out of memory");
+    a->val[AGSEQ(obj)].i = (long long) lua_tointeger(L, idx);
+    a->isset[AGSEQ(obj)] = 1;
+    a->dirty = 1;
+    return;
+  }
+#endif
+  v = lua_tonumber(L, idx);
+  if (a->isint && v != floor(v))
+    luaL_error(L, "integer expected for attribute '%s'", a->name);
+  if (numattr_set(a, obj, v))
+    luaL_error(L, "out of memory");
+}
+
+/*
+ * Attribute read through the __index metamethod. Returns 0 if name is not
+ * a numeric attribute, otherwise pushes the value or nil and returns 1.
+ */
+int numattr_index(lua_State *L, void *obj, const char *name)
+{
+  gr_numattr_t *a = numattr_find(obj, objkind(obj), name);
+
+  if (a == NULL)
+    return 0;
+  numattr_push(L, a, obj);
+  return 1;
+}
+
+/*
+ * Attribute write through the __newindex metamethod. Returns 0 if the key
+ * is not a numeric attribute, otherwise stores the value and returns 1.
+ * Lua stack: ud, key, value
+ */
+int numattr_newindex(lua_State *L)
+{
+  gr_numattr_t *a;
+  void *obj;
+
+  if (lua_type(L, 2) != LUA_TSTRING)
+    return 0;
+  obj = toobject(L, 1, NULL, STRICT)->p.p;
+  if ((a = numattr_find(obj, objkind(obj), lua_tostring(L, 2))) == NULL)
+    return 0;
+  numattr_store(L, a, obj, 3);
+  return 1;
+}
+
+/*
+ * Write the values of one numeric attribute into its string attribute.
+ */
+static void numattr_format(gr_numattr_t *a, void *obj, Agsym_t *sym)
+{
+  size_t seq = AGSEQ(obj);
+  char buf[32];
+
+  if (seq >= a->size || !a->isset[seq])
+    *buf = '\0';
+  else if (a->isint)
+    sprintf(buf, "%lld", a->val[seq].i);
+  else
+    sprintf(buf, "%.14g", a->val[seq].d);
+  agxset(obj, sym, buf);
+}
+
+/*
+ * Materialize the modified numeric attributes of the root of g as
+ * strings. Called before the graph is written, saved, layouted or
+ * rendered.
+ */
+void numattr_sync(Agraph_t *g)
+{
+  Agraph_t *root = agroot(g);
+  gr_numattr_t *a;
+  Agsym_t *sym;
+  Agnode_t *n;
+  Agedge_t *e;
+
+  for (a = numattr_first(root); a; a = a->next){
+    if (!a->dirty)
+      continue;
+    if ((sym = agattr(root, a->kind, a->name, NULL)) == NULL &&
+        (sym = agattr(root, a->kind, a->name, "")) == NULL)
+      continue;
+    for (n = agfstnode(root); n; n = agnxtnode(root, n)){
+      if (a->kind == AGNODE)
+        numattr_format(a, n, sym);
+      else
+        for (e = agfstout(root, n); e; e = agnxtout(root, e))
+          numattr_format(a, e, sym);
+    }
+    a->dirty = 0;
+  }
+}
+
+static void numattr_free(gr_numattr_t *a)
+{
+  free(a->name);
+  free(a->val);
+  free(a->isset);
+  free(a);
+}
+
+/*
+ * Drop the numeric attributes of a closed root graph.
+ */
+void del_numattrs(Agraph_t *root)
+{
+  gr_numrec_t *r = (gr_numrec_t *) aggetrec(root, NUMATTR_REC, 0);
+  gr_numattr_t *a;
+
+  if (r == NULL)
+    return;
+  while ((a = r->first) != NULL){
+    r->first = a->next;
+    numattr_free(a);
+  }
+  agdelrec(root, NUMATTR_REC);
+}
+
+/*
+ * Take over the string value of obj. Returns 0 on success, -1 if the
+ * value is not numeric or memory runs out.
+ */
+static int numattr_import(gr_numattr_t *a, void *obj, Agsym_t *sym)
+{
+  char *s = agxget(obj, sym), *end;
+  double v;
+
+  if (s == NULL || *s == '\0')
+    return 0;
+  v = strtod(s, &end);
+  if (end == s || *end != '\0' || (a->isint && v != floor(v)))
+    return -1;
+  return numattr_set(a, obj, v);
+}
+
+/*-------------------------------------------------------------------------*\
+ * Method: rv, err = g.declare_numeric(self, kind, name [, type])
+ * Declare node or edge attribute 'name' (kind "node" or "edge") as
+ * numeric. Values are kept as numbers of the given type ("number" or
+ * "integer", default "number") in dense arrays instead of strings.
+ * Reading and writing obj[name] works as usual, but returns numbers and
+ * accepts numbers or numeric strings only; nil unsets a value. The
+ * values are converted into strings only when the graph is written,
+ * saved, layouted or rendered. Existing values of the attribute are
+ * taken over. Snapshots store the string values.
+ * Returns true on success, nil plus error message otherwise.
+ * Example:
+ * g:declare_numeric("node", "score")
+ * n.score = n.score + 1
+\*-------------------------------------------------------------------------*/
+int gr_declare_numeric(lua_State *L)
+{
+  static const char *types[] = {"number", "integer", NULL};
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+  int kind = colkind(L, 2);
+  const char *name = luaL_checkstring(L, 3);
+  int isint = luaL_checkoption(L, 4, "number", types);
+  Agraph_t *root = agroot(ud->g);
+  Agsym_t *sym;
+  gr_numattr_t *a;
+  gr_numrec_t *r;
+  Agnode_t *n;
+  Agedge_t *e;
+
+  if ((a = numattr_find(root, kind, name)) != NULL){
+    if (a->isint == isint){
+      lua_pushboolean(L, 1);
+      return 1;
+    }
+    lua_pushnil(L);
+    lua_pushfstring(L, "attribute '%s' already declared as %s", name, types[a->isint]);
+    return 2;
+  }
+  if ((a = calloc(1, sizeof(gr_numattr_t))) == NULL ||
+      (a->name = strdup(name)) == NULL){
+    free(a);
+    lua_pushnil(L);
+    lua_pushstring(L, "out of memory");
+    return 2;
+  }
+  a->kind = kind;
+  a->isint = isint;
+  /* Take over existing values */
+  if ((sym = agattr(root, kind, (char *) name, NULL)) != NULL){
+    for (n = agfstnode(root); n; n = agnxtnode(root, n)){
+      if (kind == AGNODE){
+        if (numattr_import(a, n, sym))
+          goto fail;
+      } else
+        for (e = agfstout(root, n); e; e = agnxtout(root, e))
+          if (numattr_import(a, e, sym))
+            goto fail;
+    }
+    a->dirty = 0;
+  }
+  if ((r = (gr_numrec_t *) agbindrec(root, NUMATTR_REC, sizeof(gr_numrec_t), 0)) == NULL){
+    numattr_free(a);
+    lua_pushnil(L);
+    lua_pushstring(L, "out of memory");
+    return 2;
+  }
+  a->next = r->first;
+  r->first = a;
+  lua_pushboolean(L, 1);
+  return 1;
+
+fail:
+  numattr_free(a);
+  lua_pushnil(L);
+  lua_pushfstring(L, "values of %s attribute '%s' are not all %ss",
+                  kindname(kind), name, types[isint]);
+  return 2;
+}
@@ -0,0 +1,449 @@
+/*=========================================================================*\
+ * LuaGRAPH toolkit
+ * Graph support for Lua.
+ * Herbert Leuwer
+ * 30-7-2006, 01/2017
+ *
+ * Batch rendering of many DOT files in worker processes.
+ *
+\*=========================================================================*/
+
+/*=========================================================================*\
+ * Includes
+\*=========================================================================*/
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+#ifndef _WIN32
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#endif
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "gr_graph.h"
+
+/*=========================================================================*\
+ * Defines
+\*=========================================================================*/
+#define MAXWORKERS (64)
+#define ERRLEN (200)
+#define PATHLEN (4096)
+
+/*
+ * Worker processes need fork() and an atomic counter shared between them.
+ */
+#if !defined(_WIN32) && defined(__GNUC__) && defined(MAP_SHARED)
+#define USE_FORK
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
+/*=========================================================================*\
+ * Data
+\*=========================================================================*/
+/*
+ * Job description - shared by all workers.
+ */
+struct gr_batch_s {
+  const char **inputs;
+  int ninputs;
+  const char **formats;
+  int nformats;
+  const char *engine;
+  const char *outdir;
+  GVC_t *gvc;
+  int locked;               /* serialize layouts with other threads */
+};
+typedef struct gr_batch_s gr_batch_t;
+
+/*
+ * Result of one input file. Sent as a single record through a pipe, hence
+ * smaller than PIPE_BUF.
+ */
+struct gr_batchres_s {
+  int index;
+  double time;
+  char err[ERRLEN];
+};
+typedef struct gr_batchres_s gr_batchres_t;
+
+/*=========================================================================*\
+ * Functions
+\*=========================================================================*/
+/*
+ * Wall clock time in seconds.
+ */
+static double now(void)
+{
+#ifdef _WIN32
+  return (double) clock() / CLOCKS_PER_SEC;
+#else
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+#endif
+}
+
+static void seterr(gr_batchres_t *res, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vsnprintf(res->err, ERRLEN, fmt, ap);
+  va_end(ap);
+}
+
+/*
+ * Output file of input for format fmt: outdir (default: directory of the
+ * input) / input base name without extension . renderer name
+ * Returns 0 on success, -1 if the path is too long.
+ */
+static int outpath(char *buf, const char *outdir, const char *input, const char *fmt)
+{
+  const char *base, *ext, *p;
+  size_t ldir, lbase, lfmt, sep = 0;
+
+  for (base = input + strlen(input); base > input; base--)
+    if (base[-1] == '/' || base[-1] == '\\')
+      break;
+  if (outdir == NULL){
+    outdir = input;
+    ldir = base - input;
+  } else {
+    ldir = strlen(outdir);
+    sep = (ldir > 0 && outdir[ldir - 1] != '/' && outdir[ldir - 1] != '\\');
+  }
+  ext = ((p = strrchr(base, '.')) != NULL && p > base) ? p : base + strlen(base);
+  lbase = ext - base;
+  lfmt = ((p = strchr(fmt, ':')) != NULL) ? (size_t)(p - fmt) : strlen(fmt);
+  if (ldir + sep + lbase + lfmt + 2 > PATHLEN)
+    return -1;
+  memcpy(buf, outdir, ldir);
+  if (sep)
+    buf[ldir++] = '/';
+  memcpy(buf + ldir, base, lbase);
+  buf[ldir + lbase] = '.';
+  memcpy(buf + ldir + lbase + 1, fmt, lfmt);
+  buf[ldir + lbase + 1 + lfmt] = '\0';
+  return 0;
+}
+
+/*
+ * Read, layout and render input file i once per format.
+ */
+static void batch_one(gr_batch_t *b, int i, gr_batchres_t *res)
+{
+  FILE *f;
+  Agraph_t *g;
+  char path[PATHLEN];
+  double t0 = now();
+  int k;
+
+  res->index = i;
+  res->err[0] = '\0';
+  if ((f = fopen(b->inputs[i], "r")) == NULL){
+    seterr(res, "cannot open '%s'", b->inputs[i]);
+    goto done;
+  }
+  /* The lexer, layout and render state of Graphviz are global */
+  if (b->locked)
+    gv_lock();
+  g = agread(f, NULL);
+  fclose(f);
+  if (g == NULL){
+    seterr(res, "cannot read graph");
+    goto unlock;
+  }
+  if (gvLayout(b->gvc, g, b->engine) != 0){
+    seterr(res, "layout failed");
+    agclose(g);
+    goto unlock;
+  }
+  for (k = 0; k < b->nformats; k++){
+    if (outpath(path, b->outdir, b->inputs[i], b->formats[k])){
+      seterr(res, "output path too long");
+      break;
+    }
+    if (gvRenderFilename(b->gvc, g, b->formats[k], path) != 0){
+      seterr(res, "cannot render '%s'", b->formats[k]);
+      break;
+    }
+  }
+  gvFreeLayout(b->gvc, g);
+  agclose(g);
+unlock:
+  if (b->locked)
+    gv_unlock();
+done:
+  res->time = now() - t0;
+}
+
+static void batch_serial(gr_batch_t *b, gr_batchres_t *res)
+{
+  int i;
+
+  b->locked = 1;
+  for (i = 0; i < b->ninputs; i++)
+    batch_one(b, i, &res[i]);
+}
+
+#ifdef USE_FORK
+static int readfull(int fd, void *buf, size_t len)
+{
+  char *p = (char *) buf;
+  ssize_t n;
+
+  while (len > 0){
+    n = read(fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+/*
+ * Render in nworkers child processes. Each process has its own copy of
+ * the Graphviz state, so layouts run in parallel. The workers take the
+ * next input from a shared counter and send their results to the parent
+ * through one pipe.
+ * Returns 0 on success, -1 if no worker could be started.
+ */
+static int batch_fork(gr_batch_t *b, gr_batchres_t *res, int nworkers)
+{
+  int fds[2], w, n, i;
+  int *next;
+  pid_t pids[MAXWORKERS];
+  gr_batchres_t r;
+
+  next = (int *) mmap(NULL, sizeof(int), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (next == (int *) MAP_FAILED)
+    return -1;
+  *next = 0;
+  if (pipe(fds) != 0){
+    munmap(next, sizeof(int));
+    return -1;
+  }
+  fflush(NULL);
+  for (n = 0, w = 0; w < nworkers; w++){
+    if ((pids[n] = fork()) == 0){
+      close(fds[0]);
+      while ((i = __sync_fetch_and_add(next, 1)) < b->ninputs){
+        batch_one(b, i, &r);
+        if (write(fds[1], &r, sizeof(r)) != sizeof(r))
+          break;
+      }
+      _exit(0);
+    }
+    if (pids[n] > 0)
+      n++;
+  }
+  close(fds[1]);
+  if (n > 0)
+    while (readfull(fds[0], &r, sizeof(r)) == 0)
+      if (r.index >= 0 && r.index < b->ninputs)
+        res[r.index] = r;
+  close(fds[0]);
+  for (w = 0; w < n; w++)
+    while (waitpid(pids[w], NULL, 0) < 0 && errno == EINTR)
+      ;
+  munmap(next, sizeof(int));
+  return (n > 0) ? 0 : -1;
+}
+#endif
+
+static int ncpus(void)
+{
+#if !defined(_WIN32) && defined(_SC_NPROCESSORS_ONLN)
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return (n > 0) ? (int) n : 1;
+#else
+  return 1;
+#endif
+}
+
+/*
+ * Check that field name of the options table at idx is missing, a string
+ * or an array of strings. Raises an error otherwise.
+ */
+static void checkstrarray(lua_State *L, int idx, const char *name)
+{
+  int i, n;
+
+  lua_getfield(L, idx, name);                           /* ..., v */
+  if (!lua_isnil(L, -1) && !lua_isstring(L, -1)){
+    if (!lua_istable(L, -1))
+      luaL_error(L, "bad field '%s' (array of strings expected)", name);
+    n = (int) lua_rawlen(L, -1);
+    for (i = 1; i <= n; i++){
+      lua_rawgeti(L, -1, i);                            /* ..., t, s */
+      if (!lua_isstring(L, -1))
+        luaL_error(L, "bad field '%s' (array of strings expected)", name);
+      lua_pop(L, 1);                                    /* ..., t */
+    }
+  }
+  lua_pop(L, 1);                                        /* ... */
+}
+
+/*
+ * Collect the strings of array field name of the options table at idx,
+ * which must have been checked with checkstrarray(). A string counts as
+ * array with one element. The strings stay referenced by the options table.
+ * Returns the number of strings, 0 if the field is missing or -1 if out
+ * of memory.
+ */
+static int strarray(lua_State *L, int idx, const char *name, const char ***list)
+{
+  int i, n;
+
+  *list = NULL;
+  lua_getfield(L, idx, name);                           /* ..., v */
+  if (lua_isnil(L, -1)){
+    lua_pop(L, 1);
+    return 0;
+  }
+  n = lua_isstring(L, -1) ? 1 : (int) lua_rawlen(L, -1);
+  if ((*list = malloc((n + 1) * sizeof(char *))) == NULL){
+    lua_pop(L, 1);
+    return -1;
+  }
+  if (lua_isstring(L, -1))
+    (*list)[0] = lua_tostring(L, -1);
+  else
+    for (i = 0; i < n; i++){
+      lua_rawgeti(L, -1, i + 1);                        /* ..., t, s */
+      (*list)[i] = lua_tostring(L, -1);
+      lua_pop(L, 1);                                    /* ..., t */
+    }
+  lua_pop(L, 1);                                        /* ... */
+  return n;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Function: results, time = graph.batchrender(options)
+ * Read, layout and render many DOT files. Each graph is layouted once and
+ * rendered into every format. The files are processed by a pool of worker
+ * processes with separate Graphviz contexts; on Windows or with
+ * threads = 1 they are processed one after the other.
+ * Options is a table with the fields:
+ *   inputs:  array of DOT file names
+ *   formats: array of output formats (default: {"svg"})
+ *   engine:  layout engine (default: "dot")
+ *   threads: number of workers (default: number of CPUs)
+ *   outdir:  output directory (default: directory of the input)
+ * Output files are named after the input with the extension replaced by
+ * the format. results holds a table per input in the order of inputs with
+ * the fields input, time (seconds) and ok = true or error = message;
+ * time is the total elapsed time.
+ * Example:
+ * res = graph.batchrender{inputs = files, formats = {"svg", "png"},
+ *                         outdir = "out"}
+ * for _, r in ipairs(res) do print(r.input, r.time, r.error) end
+\*-------------------------------------------------------------------------*/
+int gr_batchrender(lua_State *L)
+{
+  gr_batch_t b;
+  gr_batchres_t *res;
+  const char *deffmt[1] = {"svg"};
+  int i, nworkers;
+  double t0 = now();
+
+  luaL_checktype(L, 1, LUA_TTABLE);
+  lua_settop(L, 1);
+  memset(&b, 0, sizeof(b));
+  b.engine = optstrfield(L, 1, "engine");
+  if (b.engine == NULL)
+    b.engine = "dot";
+  if (!gv_isengine(b.engine))
+    return luaL_error(L, "invalid layout format '%s'", b.engine);
+  b.outdir = optstrfield(L, 1, "outdir");
+  nworkers = (int) optnumfield(L, 1, "threads", ncpus());
+  lua_getfield(L, 1, "inputs");
+  luaL_argcheck(L, !lua_isnil(L, -1), 1, "field 'inputs' missing");
+  lua_pop(L, 1);
+  checkstrarray(L, 1, "inputs");
+  checkstrarray(L, 1, "formats");
+  if ((b.ninputs = strarray(L, 1, "inputs", &b.inputs)) < 0)
+    goto nomem;
+  if ((b.nformats = strarray(L, 1, "formats", &b.formats)) < 0)
+    goto nomem;
+  if (b.nformats == 0){
+    b.nformats = 1;
+    free(b.formats);
+    b.formats = NULL;
+  }
+  if ((res = malloc((b.ninputs + 1) * sizeof(gr_batchres_t))) == NULL)
+    goto nomem;
+  for (i = 0; i < b.ninputs; i++){
+    res[i].index = i;
+    res[i].time = 0;
+    seterr(&res[i], "worker failed");
+  }
+  gv_lock();
+  b.gvc = gv_context();
+  gv_unlock();
+  if (b.gvc == NULL){
+    free(res);
+    free(b.inputs);
+    free(b.formats);
+    lua_pushnil(L);
+    lua_pushstring(L, "cannot load plugins");
+    return 2;
+  }
+  if (b.formats == NULL)
+    b.formats = deffmt;
+  if (nworkers > MAXWORKERS)
+    nworkers = MAXWORKERS;
+  if (nworkers > b.ninputs)
+    nworkers = b.ninputs;
+#ifdef USE_FORK
+  if (nworkers <= 1 || batch_fork(&b, res, nworkers) != 0)
+#endif
+    batch_serial(&b, res);
+  gv_lock();
+  gvFreeContext(b.gvc);
+  gv_unlock();
+
+  lua_createtable(L, b.ninputs, 0);                    /* opt, t */
+  for (i = 0; i < b.ninputs; i++){
+    lua_createtable(L, 0, 3);                          /* ..., t, r */
+    lua_pushstring(L, b.inputs[i]);
+    lua_setfield(L, -2, "input");
+    lua_pushnumber(L, res[i].time);
+    lua_setfield(L, -2, "time");
+    if (res[i].err[0] == '\0'){
+      lua_pushboolean(L, 1);
+      lua_setfield(L, -2, "ok");
+    } else {
+      lua_pushstring(L, res[i].err);
+      lua_setfield(L, -2, "error");
+    }
+    lua_rawseti(L, -2, i + 1);                         /* ..., t */
+  }
+  lua_pushnumber(L, now() - t0);                       /* opt, t, time */
+  free(res);
+  free(b.inputs);
+  if (b.formats != deffmt)
+    free(b.formats);
+  return 2;
+
+nomem:
+  free(b.inputs);
+  free(b.formats);
+  lua_pushnil(L);
+  lua_pushstring(L, "out of memory");
+  return 2;
+}
@@ -81,9 +81,13 @@ static const luaL_Reg reg_metamethods[] = {
 /*-------------------------------------------------------------------------*\
  * Utility Functions
 \*-------------------------------------------------------------------------*/
+int init_edge(lua_State *L){
+  return new_metatable(L, "edge", reg_rmembers, reg_methods, reg_metamethods, 
+                       object_index_handler);
+}
+
 int new_edge(lua_State *L){
-  return new_object(L, "edge", reg_rmembers, reg_methods, reg_metamethods, 
-		    object_index_handler);
+  return new_object(L, "edge");
 }
 
 /*-------------------------------------------------------------------------*\
@@ -204,7 +208,7 @@ static int gr_head(lua_State *L)
     lua_pushnil(L);
     return 1;
   } else
-    return get_object(L, n);
+    return push_object(L, n);
 }
 
 static int gr_tail(lua_State *L)
@@ -215,7 +219,7 @@ static int gr_tail(lua_State *L)
     lua_pushnil(L);
     return 1;
   } else
-    return get_object(L, n);
+    return push_object(L, n);
 }
 
 /*-------------------------------------------------------------------------*\
@@ -234,7 +238,7 @@ static int gr_graphof(lua_State *L)
     lua_pushstring(L, "no graph");
     return 2;
   }
-  return get_object(L, g);
+  return push_object(L, g);
 }
 
 static int gr_tostring(lua_State *L)
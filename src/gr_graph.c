@@ -50,8 +50,12 @@ static int gr_open(lua_State *L);
 static int gr_close(lua_State *L);
 static int gr_nameof(lua_State *L);
 static int gr_write(lua_State *L);
+static int gr_writestring(lua_State *L);
 static int gr_read(lua_State *L);
 static int gr_memread(lua_State *L);
+static int gr_readall(lua_State *L);
+static int gr_save(lua_State *L);
+static int gr_load(lua_State *L);
 static int gr_isstrict(lua_State *L);
 static int gr_isdirected(lua_State *L);
 static int gr_nnodes(lua_State *L);
@@ -75,17 +79,32 @@ static int gr_setattr(lua_State *L);
 static int gr_delete(lua_State *L);
 static int gr_node(lua_State *L);
 static int gr_edge(lua_State *L);
+static int gr_addedges(lua_State *L);
 static int gr_findedge(lua_State *L);
 static int gr_idnode(lua_State *L);
 static int gr_nextnode(lua_State *L);
 static int gr_walknodes(lua_State *L);
+static int gr_nodenames(lua_State *L);
+static int gr_nodeids(lua_State *L);
+static int gr_nodes(lua_State *L);
+static int gr_nextnodeid(lua_State *L);
+static int gr_walknodeids(lua_State *L);
 static int gr_graphof(lua_State *L);
 static int gr_contains(lua_State *L);
 static int gr_layout(lua_State *L);
 static int gr_freelayout(lua_State *L);
 static int gr_render(lua_State *L);
+static int gr_renderdata(lua_State *L);
+static int gr_renderall(lua_State *L);
 static int gr_plugins(lua_State *L);
 static int gr_tostring(lua_State *L);
+static int gr_context(lua_State *L);
+static int layout(lua_State *L, GVC_t *ctx);
+static int freelayout(lua_State *L, GVC_t *ctx);
+static int render(lua_State *L, GVC_t *ctx);
+static int renderdata(lua_State *L, GVC_t *ctx);
+static int plugins(lua_State *L, GVC_t *ctx);
+static GVC_t *curcontext(lua_State *L);
 
 /*=========================================================================*\
  * Data
@@ -126,6 +145,11 @@ static const luaL_Reg funcs[] = {
   {"close", gr_close},
   {"read", gr_read},
   {"memread", gr_memread},
+  {"readall", gr_readall},
+  {"load", gr_load},
+  {"layoutcache", gr_layoutcache},
+  {"context", gr_context},
+  {"batchrender", gr_batchrender},
   {"equal", gr_equal},
   {NULL, NULL}
 };
@@ -136,6 +160,8 @@ static const luaL_Reg funcs[] = {
 static const luaL_Reg reg_methods[] = {
   {"close", gr_close},
   {"write", gr_write},
+  {"writestring", gr_writestring},
+  {"save", gr_save},
   {"subgraph", gr_subgraph},
   {"getnext", gr_getnext},
   {"nextgraph", gr_getnext},
@@ -154,15 +180,38 @@ static const luaL_Reg reg_methods[] = {
   {"delete", gr_delete},
   {"node", gr_node},
   {"edge", gr_edge},
+  {"addedges", gr_addedges},
   {"findedge", gr_findedge},
   {"idnode", gr_idnode},
   {"nextnode", gr_nextnode},
   {"walknodes", gr_walknodes},
+  {"nodenames", gr_nodenames},
+  {"nodeids", gr_nodeids},
+  {"nodes", gr_nodes},
+  {"nextnodeid", gr_nextnodeid},
+  {"walknodeids", gr_walknodeids},
+  {"csr", gr_csr},
+  {"shortestpaths", gr_shortestpaths},
+  {"path", gr_path},
+  {"scc", gr_scc},
+  {"toposort", gr_toposort},
+  {"components", gr_components},
+  {"pagerank", gr_pagerank},
+  {"betweenness", gr_betweenness},
+  {"positions", gr_positions},
+  {"splines", gr_splines},
   {"type", get_object_type},
   {"contains", gr_contains},
   {"layout", gr_layout},
+  {"layout_async", gr_layout_async},
   {"freelayout", gr_freelayout},
   {"render", gr_render},
+  {"renderdata", gr_renderdata},
+  {"renderall", gr_renderall},
+  {"attrsym", gr_attrsym},
+  {"getcolumn", gr_getcolumn},
+  {"setcolumn", gr_setcolumn},
+  {"declare_numeric", gr_declare_numeric},
   {"rawget", getval},
   {NULL, NULL}
 };
@@ -197,13 +246,63 @@ static const luaL_Reg reg_metamethods[] = {
 };
 
 /*
- * Event callback functions - used for registring/unregstring proxy objects
- * in Lua registry.
+ * Stream reader metamethods
+ */
+static int reader_collect(lua_State *L);
+static const luaL_Reg reg_reader_metamethods[] = {
+  {"__gc", reader_collect},
+  {NULL, NULL}
+};
+
+/*
+ * Graphviz context methods
+ */
+static int ctx_layout(lua_State *L);
+static int ctx_freelayout(lua_State *L);
+static int ctx_render(lua_State *L);
+static int ctx_renderdata(lua_State *L);
+static int ctx_plugins(lua_State *L);
+static int ctx_close(lua_State *L);
+static const luaL_Reg reg_context_methods[] = {
+  {"layout", ctx_layout},
+  {"freelayout", ctx_freelayout},
+  {"render", ctx_render},
+  {"renderdata", ctx_renderdata},
+  {"plugins", ctx_plugins},
+  {"close", ctx_close},
+  {"__gc", ctx_close},
+  {NULL, NULL}
+};
+
+/*
+ * Graphviz context created by graph.context()
+ */
+struct gr_context_s {
+  GVC_t *gvc;
+};
+typedef struct gr_context_s gr_context_t;
+
+#define CONTEXT_DEFAULT "luagraph.context"
+
+/*
+ * Stream reader state for graph.readall()
+ */
+struct gr_reader_s {
+  FILE *f;
+  int doclose;
+  int ngraphs;
+};
+typedef struct gr_reader_s gr_reader_t;
+
+/*
+ * Event callback functions - used for unregistering proxy objects in Lua
+ * registry. Proxies register themselves when they are created (see
+ * new_object()), so there is no work for cgraph on insertion.
  */
 static const struct Agcbdisc_s disc = {
-  { cb_insert, cb_modify, cb_delete}, /* graph callbacks */
-  { cb_insert, cb_modify, cb_delete}, /* node callbacks */
-  { cb_insert, cb_modify, cb_delete}, /* edge callbacks */
+  { NULL, NULL, cb_delete}, /* graph callbacks */
+  { NULL, NULL, cb_delete}, /* node callbacks */
+  { NULL, NULL, cb_delete}, /* edge callbacks */
 };
 
 /*=========================================================================*\
@@ -213,30 +312,82 @@ static const struct Agcbdisc_s disc = {
  * Utility Functions
 \*-------------------------------------------------------------------------*/
 
+/*
+ * Create the graph metatable.
+ */
+static int init_graph(lua_State *L){
+  return new_metatable(L, "graph", reg_rmembers, reg_methods,
+                       reg_metamethods, object_index_handler);
+}
+
 /*
  * Create a new Lua userdata object and configure metatable.
  */
 static int new_graph(lua_State *L){
-  return   new_object(L, "graph", reg_rmembers, reg_methods,
-                      reg_metamethods, object_index_handler);
+  return new_object(L, "graph");
 }
 
 #define DEMAND_LOADING (1)
 
 /*
- * Layout a graph using given engine.
+ * Create the proxy for a root graph read by cgraph and install callbacks.
+ * Lua exit stack: ?, ud
  */
-static int gv_layout(Agraph_t *g, const char *engine)
+static int new_rootgraph(lua_State *L, Agraph_t *g)
 {
-  int rv = gvLayout(gvc, g, engine);
+  gr_graph_t *ud = lua_newuserdata(L, sizeof(gr_graph_t));
+  ud->g = g;
+  ud->name = strdup(agnameof(g));
+  ud->type = AGRAPH;
+  ud->status = ALIVE;
+  ud->lastedge = NULL;
+  agpushdisc(g, (struct Agcbdisc_s *)&disc, L);
+  return new_graph(L);
+}
+
+/*
+ * Create an additional Graphviz context with the same plugins.
+ */
+GVC_t *gv_context(void)
+{
+  return gvContextPlugins(lt_preloaded_symbols, DEMAND_LOADING);
+}
+
+/*
+ * Check for a valid layout engine name.
+ */
+int gv_isengine(const char *engine)
+{
+  return (!strcmp(engine, "dot") ||
+          !strcmp(engine, "neato") ||
+          !strcmp(engine, "nop") ||
+          !strcmp(engine, "nop2") ||
+          !strcmp(engine, "twopi") ||
+          !strcmp(engine, "fdp") ||
+          !strcmp(engine, "circo"));
+}
+
+/*
+ * Layout a graph using given engine - through the layout cache.
+ */
+static int gv_layout(lua_State *L, GVC_t *ctx, Agraph_t *g, const char *engine)
+{
+  int rv;
+
+  numattr_sync(g);
+  rv = lcache_layout(L, ctx, g, engine);
   if (rv != 0)
     return GR_ERROR;
   return GR_SUCCESS;
 }
 
-static int gv_free_layout(Agraph_t *g)
+static int gv_free_layout(GVC_t *ctx, Agraph_t *g)
 {
-  int rv = gvFreeLayout(gvc, g);
+  int rv;
+
+  gv_lock();
+  rv = gvFreeLayout(ctx, g);
+  gv_unlock();
   if (rv != 0)
     return GR_ERROR;
   return GR_SUCCESS;
@@ -246,9 +397,14 @@ static int gv_free_layout(Agraph_t *g)
  * Render layouted graph into a file given by file handle
  * using given format.
  */
-static int gv_render(Agraph_t *g, const char *fmt, FILE *fout)
+static int gv_render(GVC_t *ctx, Agraph_t *g, const char *fmt, FILE *fout)
 {
-int rv = gvRender(gvc, g, fmt, fout);
+  int rv;
+
+  numattr_sync(g);
+  gv_lock();
+  rv = gvRender(ctx, g, fmt, fout);
+  gv_unlock();
   if (rv != 0)
     return GR_ERROR;
   return GR_SUCCESS;      
@@ -257,9 +413,32 @@ int rv = gvRender(gvc, g, fmt, fout);
  * Render layouted graph into a file given by file name using given
  * format.
  */
-static int gv_render_file(Agraph_t *g, const char *fmt, const char *fname)
+static int gv_render_file(GVC_t *ctx, Agraph_t *g, const char *fmt, const char *fname)
+{
+  int rv;
+
+  numattr_sync(g);
+  gv_lock();
+  rv = gvRenderFilename(ctx, g, fmt, fname);
+  gv_unlock();
+  if (rv != 0)
+    return GR_ERROR;
+  return GR_SUCCESS;
+}
+
+/*
+ * Render layouted graph into a memory buffer using given format.
+ * The buffer must be released with gvFreeRenderData().
+ */
+static int gv_render_data(GVC_t *ctx, Agraph_t *g, const char *fmt, char **data,
+                          gv_datalen_t *len)
 {
-  int rv = gvRenderFilename(gvc, g, fmt, fname);
+  int rv;
+
+  numattr_sync(g);
+  gv_lock();
+  rv = gvRenderData(ctx, g, fmt, data, len);
+  gv_unlock();
   if (rv != 0)
     return GR_ERROR;
   return GR_SUCCESS;
@@ -369,10 +548,7 @@ static int gr_open(lua_State *L)
   ud->type = AGRAPH;
   ud->status = ALIVE;
   /* We need a few default fields */
-  if (!agattr(ud->g, AGEDGE, "label", "") ||
-      !agattr(ud->g, AGRAPH, "__attrib__", "") ||
-      !agattr(ud->g, AGEDGE, "__attrib__", "") ||
-      !agattr(ud->g, AGNODE, "__attrib__", "")){
+  if (!agattr(ud->g, AGEDGE, "label", "")){
     luaL_error(L, "declaration failed");
     return 0;
   }
@@ -381,8 +557,6 @@ static int gr_open(lua_State *L)
   if (ud->g == agroot(ud->g)){
     agpushdisc(ud->g, (struct Agcbdisc_s *)&disc, L);
   }
-
-  set_object(L, ud->g);
   return new_graph(L);
 }
 
@@ -401,10 +575,22 @@ static int gr_close(lua_State *L)
   if (ud->g != NULL){
 
     if (ud->status == ALIVE) {
+      Agraph_t *g = ud->g;
+      int isroot = (agroot(g) == g);
       /* Delete the graph, if it still exists */
       TRACE("   g:close(): graph: ud=%p '%s' ptr=%p type=%d (%s %d)\n", 
             (void *) ud, agnameof(ud->g), (void *)ud->g, AGTYPE(ud->g), __FILE__, __LINE__);
-      agclose(ud->g);
+      if (isroot){
+        /*
+         * Fast teardown: proxies and fields of all objects are dropped at
+         * once, agclose() runs without per-object delete callbacks.
+         */
+        del_cache(L, g);
+        del_fields(L, g);
+        del_numattrs(g);
+        agpopdisc(g, (struct Agcbdisc_s *)&disc);
+      }
+      agclose(g);
     }
   } else {
     TRACE("   g:close(): graph: ud=%p already closed (%s %d)\n", (void *) ud, __FILE__, __LINE__);
@@ -465,38 +651,43 @@ static int gr_isdirected(lua_State *L)
 \*-------------------------------------------------------------------------*/
 static int gr_memread(lua_State *L)
 {
-  gr_graph_t *ud;
-  char *str = (char *)lua_tostring(L, 1);
+  Agraph_t *g;
 
-  ud = lua_newuserdata(L, sizeof(gr_graph_t));
-  if (!(ud->g = agmemread(str))){
+  luaL_checkstring(L, 1);
+  if (!(g = read_graph(L, 1))){
     lua_pushnil(L);
     lua_pushstring(L, "agread failed");
     return 2;
   }
-  ud->name = strdup(agnameof(ud->g));
-  ud->type = AGRAPH;
-  ud->status = ALIVE;
-  
-  /* We set callbacks only in root graph */
-  if (ud->g == agroot(ud->g)){
-    agpushdisc(ud->g, (struct Agcbdisc_s *)&disc, L);
-  }
-  set_object(L, ud->g);
-  return new_graph(L);
+  return new_rootgraph(L, g);
 }
 
 /*-------------------------------------------------------------------------* \
  * Read a graph from a file; "stdin" reads from STDIN.
+ * Instead of a filename an open Lua file handle or a reader function 
+ * can be given. The reader function returns successive chunks of text 
+ * and nil or "" at the end.
  * Returns graph userdata.
  * Example:
  * g, err = graph.read(filename)
+ * g, err = graph.read(io.popen("zcat big.dot.gz"))
+ * g, err = graph.read(function() return sock:receive(4096) end)
 \*-------------------------------------------------------------------------*/
 static int gr_read(lua_State *L)
 {
-  gr_graph_t *ud;
+  Agraph_t *g;
   FILE *fin;
-  char *fname = (char *)luaL_optstring(L, 1, "stdin");
+  char *fname;
+
+  if (lua_isuserdata(L, 1) || lua_isfunction(L, 1)){
+    if (!(g = read_graph(L, 1))){
+      lua_pushnil(L);
+      lua_pushstring(L, "agread failed");
+      return 2;
+    }
+    return new_rootgraph(L, g);
+  }
+  fname = (char *)luaL_optstring(L, 1, "stdin");
 
   if (!strcmp(fname, "stdin")){
     fin = stdin;
@@ -508,40 +699,118 @@ static int gr_read(lua_State *L)
     lua_pushstring(L, "fopen failed");
     return 2;
   }
-  /* Create a userdata */
-  ud = lua_newuserdata(L, sizeof(gr_graph_t));
-  if (!(ud->g = agread(fin, NIL(Agdisc_t*)))){
-    fclose(fin);
+  g = agread(fin, NIL(Agdisc_t*));
+  fclose(fin);
+  if (!g){
     lua_pushnil(L);
     lua_pushstring(L, "agread failed");
     return 2;
   }
-  fclose(fin);
-  ud->name = strdup(agnameof(ud->g));
-  ud->type = AGRAPH;
-  ud->status = ALIVE;
-  
-  /* We set callbacks only in root graph */
-  if (ud->g == agroot(ud->g)){
-    agpushdisc(ud->g, (struct Agcbdisc_s *)&disc, L);
+  return new_rootgraph(L, g);
+}
+
+/*
+ * Close the stream of a reader.
+ */
+static void reader_close(gr_reader_t *rd)
+{
+  if (rd->f != NULL && rd->doclose)
+    fclose(rd->f);
+  rd->f = NULL;
+}
+
+static int reader_collect(lua_State *L)
+{
+  reader_close((gr_reader_t *) lua_touserdata(L, 1));
+  return 0;
+}
+
+/*
+ * Iterator function of graph.readall(): reads the next graph from the 
+ * stream given as upvalue. The stream is closed after the last graph.
+ * agread() returns NULL at the end of the stream as well as on a syntax
+ * error, the error level of cgraph tells them apart.
+ */
+static int gr_readnext(lua_State *L)
+{
+  Agraph_t *g;
+  gr_reader_t *rd = (gr_reader_t *) lua_touserdata(L, lua_upvalueindex(1));
+
+  if (rd->f == NULL){
+    lua_pushnil(L);
+    return 1;
   }
-  set_object(L, ud->g);
-  return new_graph(L);
+  agreseterrors();
+  if ((g = agread(rd->f, NIL(Agdisc_t*))) == NULL){
+    reader_close(rd);
+    if (agerrors() >= AGERR)
+      luaL_error(L, "agread failed after %d graphs", rd->ngraphs);
+    lua_pushnil(L);
+    return 1;
+  }
+  rd->ngraphs++;
+  return new_rootgraph(L, g);
+}
+
+/*-------------------------------------------------------------------------*\
+ * Iterator: graph.readall(filename)
+ * Iterator over all graphs in a file; "stdin" reads from STDIN.
+ * The file is opened once and the graphs are parsed one at a time, so 
+ * each graph can be closed before the next one is read.
+ * Raises an error if a graph in the file cannot be parsed.
+ * Note: cgraph's scanner keeps lookahead in global state. Don't read from 
+ * other sources while an iteration is in progress.
+ * Example:
+ * for g in graph.readall(filename) do ... g:close() end
+\*-------------------------------------------------------------------------*/
+static int gr_readall(lua_State *L)
+{
+  gr_reader_t *rd;
+  char *fname = (char *)luaL_optstring(L, 1, "stdin");
+
+  rd = lua_newuserdata(L, sizeof(gr_reader_t));    /* fname, rd */
+  rd->f = NULL;
+  rd->doclose = 0;
+  rd->ngraphs = 0;
+  luaL_getmetatable(L, "graph.reader");
+  lua_setmetatable(L, -2);
+  if (!strcmp(fname, "stdin")){
+    rd->f = stdin;
+  } else {
+    rd->f = fopen(fname, "r");
+    rd->doclose = 1;
+  }
+  if (!rd->f){
+    lua_pushnil(L);
+    lua_pushstring(L, "fopen failed");
+    return 2;
+  }
+  lua_pushcclosure(L, gr_readnext, 1);             /* fname, iter */
+  return 1;
 }
 
 /*-------------------------------------------------------------------------*\
  * Method: g.write(self, filename) 
- * Write a graph into a file.
- * Returns 1 on success, nil plus error message on failure.
+ *         g.write(self, sink)
+ * Write a graph into a file or stream it to a sink function, which is 
+ * called with one chunk of DOT text per call. The text is serialized in
+ * memory first, so the sink may itself write graphs.
+ * Returns 0 on success, nil plus error message on failure.
  * rv, err = g:write(filename)
+ * rv, err = g:write(function(chunk) sock:send(chunk) end)
 \*-------------------------------------------------------------------------*/
 static int gr_write(lua_State *L)
 {
   int rv;
   FILE *fout;
   int stdflag = 0;
+  char *fname;
   gr_graph_t *ud = tograph(L, 1, STRICT);
-  char *fname = (char*) luaL_optstring(L, 2, "__std__");
+
+  numattr_sync(ud->g);
+  if (lua_isfunction(L, 2))
+    return write_sink(L, ud->g, 2);
+  fname = (char*) luaL_optstring(L, 2, "__std__");
 
   if (!strcmp(fname, "__std__")){
     stdflag = 1;
@@ -568,6 +837,67 @@ static int gr_write(lua_State *L)
   return 1;
 }
 
+/*-------------------------------------------------------------------------*\
+ * Method: s, err = g.writestring(self) 
+ * Write a graph in DOT notation into a string.
+ * Returns the string on success, nil plus error message on failure.
+ * s, err = g:writestring()
+\*-------------------------------------------------------------------------*/
+static int gr_writestring(lua_State *L)
+{
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+
+  numattr_sync(ud->g);
+  return write_string(L, ud->g);
+}
+
+/*-------------------------------------------------------------------------*\
+ * Method: rv, err = g.save(self, filename)
+ * Save a root graph into a binary snapshot file. The snapshot holds the
+ * subgraph tree, nodes, edges, attribute declarations and values and
+ * loads much faster than DOT text.
+ * Returns true on success, nil plus error message on failure.
+ * Example:
+ * rv, err = g:save(filename)
+\*-------------------------------------------------------------------------*/
+static int gr_save(lua_State *L)
+{
+  const char *err;
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+  const char *fname = luaL_checkstring(L, 2);
+
+  if (ud->g != agroot(ud->g))
+    luaL_error(L, "root graph expected");
+  numattr_sync(ud->g);
+  if (save_graph(ud->g, fname, &err)){
+    lua_pushnil(L);
+    lua_pushstring(L, err);
+    return 2;
+  }
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Load a graph from a binary snapshot file written by g:save().
+ * Returns graph userdata.
+ * Example:
+ * g, err = graph.load(filename)
+\*-------------------------------------------------------------------------*/
+static int gr_load(lua_State *L)
+{
+  Agraph_t *g;
+  const char *err;
+  const char *fname = luaL_checkstring(L, 1);
+
+  if ((g = load_graph(fname, &err)) == NULL){
+    lua_pushnil(L);
+    lua_pushstring(L, err);
+    return 2;
+  }
+  return new_rootgraph(L, g);
+}
+
 /*-------------------------------------------------------------------------*\
  * Property:nnodes [number]
  * Provides the numebr of edges of a graph
@@ -617,7 +947,6 @@ static int gr_equal(lua_State *L)
 \*-------------------------------------------------------------------------*/
 static int gr_subgraph(lua_State *L)
 {
-  int rv;
   Agraph_t *g;
   gr_graph_t *sg; 
   gr_graph_t *ud = tograph(L, 1, STRICT);
@@ -627,16 +956,7 @@ static int gr_subgraph(lua_State *L)
   if ((g = agsubg(ud->g, name, 0)) != NULL){
 
     /* Yes - return corresponing userdata */
-    rv = get_object(L, g);
-    if (lua_isnil(L, -rv)){
-      sg = lua_newuserdata(L, sizeof(gr_graph_t));
-      sg->g = g;
-      sg->name = strdup(name);
-      sg->type = AGRAPH;
-      sg->status = ALIVE;
-      return new_graph(L);
-    } else 
-      return rv;
+    return push_object(L, g);
   } else {
     /* No - Create a new one  */
     if (lua_toboolean(L, 3)){
@@ -674,7 +994,7 @@ static int gr_root(lua_State *L)
     lua_pushstring(L, "agroot failed");
   }
   lua_pop(L, 1);                  /* empty */
-  return get_object(L, g);        /* root */
+  return push_object(L, g);       /* root */
 }
 
 /*-------------------------------------------------------------------------*\
@@ -688,7 +1008,12 @@ static int gr_parent(lua_State *L)
   gr_graph_t *ud = tograph(L, 1, STRICT);
   Agraph_t *g = agparent(ud->g);
   
-  return get_object(L, g);
+  if (g == NULL){
+    lua_pushnil(L);
+    lua_pushstring(L, "no parent");
+    return 2;
+  }
+  return push_object(L, g);
 }
 
 /*-------------------------------------------------------------------------*\
@@ -727,7 +1052,6 @@ static int gr_getnext(lua_State *L)
       ud_sg->name = strdup(agnameof(g));
       ud_sg->type = AGRAPH;
       ud_sg->status = ALIVE;
-      set_object(L, g);
       return new_graph(L);
     }
   } 
@@ -964,7 +1288,6 @@ static int gr_node(lua_State *L)
 {
   Agnode_t *n;
   gr_node_t *node;                 
-  int rv;
   char *name;
   
   /* param 1: graph = self */
@@ -973,19 +1296,8 @@ static int gr_node(lua_State *L)
   name = (char *) luaL_checkstring(L, 2);          /* ud, name */
 
   if (name && (n = agnode(ud->g, name, 0)) != NULL){
-    rv = get_object(L, n);                           /* ud, name, node/nil */
-    if (lua_isnil(L, -rv)){
-      lua_pop(L, rv);                                /* ud, name */
-      /* Node not yet registered */
-      node = lua_newuserdata(L, sizeof(gr_node_t));  /* ud, name, node */
-      node->n = n;
-      node->name = strdup(agnameof(n));
-      node->type = AGNODE;
-      node->status = ALIVE;
-      return new_node(L);                            
-    } else 
-      /* Node already registered */
-      return rv;                                     /* ud, name, node */
+    /* Node exists: return its proxy - registered on the fly if necessary */
+    return push_object(L, n);                        /* ud, name, node */
   } else {
     /* Node does not exist */
     if (lua_toboolean(L, 3)){
@@ -1025,7 +1337,6 @@ static int gr_edge(lua_State *L)
   Agedge_t *e;
   gr_edge_t *edge;                 
   gr_node_t *tail, *head;
-  int rv;
   char ename[32];
   char *label;
   int head_created = 0;
@@ -1082,12 +1393,7 @@ static int gr_edge(lua_State *L)
       /* strict directed graph: give edge a new label */
       agsafeset(e, "label", label, NULL);
     } 
-    rv = get_object(L, e);
-    if (lua_isnil(L, -rv)){
-      rv = get_object(L, agopp(e));
-      if (lua_isnil(L, -rv))
-        return rv;
-    }
+    push_object(L, e);
     lua_pushlightuserdata(L, tail);
     lua_pushlightuserdata(L, head);
     return 3;
@@ -1134,6 +1440,100 @@ static int gr_edge(lua_State *L)
   return 3;
 }
 
+/*-------------------------------------------------------------------------*\
+ * Method: n = g.addedges(self, tails, heads [, attrs])
+ * Bulk import of an edge list. The i-th edge connects the nodes tails[i]
+ * and heads[i], which are given by name or number. Missing nodes are
+ * created. The optional table attrs holds attribute columns: the value
+ * attrs[key][i] is assigned to attribute key of the i-th edge.
+ * All nodes and edges are created in one pass without Lua proxies; proxies
+ * are created on demand when the objects are accessed later.
+ * As with g:edge(), an existing edge between the same nodes is reused and
+ * only its attributes are updated; also on non-strict graphs.
+ * Returns the number of edges created.
+ * Example:
+ * n = g:addedges({"n1", "n2"}, {"n2", "n3"}, {color = {"red", "blue"}})
+\*-------------------------------------------------------------------------*/
+static int gr_addedges(lua_State *L)
+{
+  int i, j, n, base, top;
+  int nattr = 0;
+  int count = 0;
+  Agnode_t *tail, *head;
+  Agedge_t *e;
+  Agsym_t **syms = NULL;
+  gr_numattr_t **nums = NULL;
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+  Agraph_t *root = agroot(ud->g);
+
+  luaL_checktype(L, 2, LUA_TTABLE);
+  luaL_checktype(L, 3, LUA_TTABLE);
+  n = lua_rawlen(L, 2);
+  if ((int) lua_rawlen(L, 3) != n)
+    return luaL_error(L, "tails and heads differ in length");
+  lua_settop(L, 4);                                 /* ud, tails, heads, attrs */
+
+  /* Resolve attribute symbols once; columns are kept on the stack */
+  if (!lua_isnil(L, 4)){
+    luaL_checktype(L, 4, LUA_TTABLE);
+    lua_pushnil(L);
+    while (lua_next(L, 4)){
+      nattr++;
+      lua_pop(L, 1);
+    }
+    syms = lua_newuserdata(L, (nattr + 1) * (sizeof(Agsym_t *) + sizeof(gr_numattr_t *)));
+    nums = (gr_numattr_t **) (syms + nattr + 1);      /* ..., syms */
+    luaL_checkstack(L, nattr + 8, "too many attribute columns");
+    j = 0;
+    lua_pushnil(L);                                 /* ..., syms, [col...], nil */
+    while (lua_next(L, 4)){                         /* ..., syms, [col...], key, col */
+      if (lua_type(L, -2) != LUA_TSTRING || !lua_istable(L, -1))
+        return luaL_error(L, "invalid attribute column");
+      /* Numeric attributes bypass the string attribute */
+      syms[j] = NULL;
+      if ((nums[j] = numattr_find(root, AGEDGE, lua_tostring(L, -2))) == NULL &&
+          (syms[j] = agattr(root, AGEDGE, (char *) lua_tostring(L, -2), NULL)) == NULL &&
+          (syms[j] = agattr(root, AGEDGE, (char *) lua_tostring(L, -2), "")) == NULL)
+        return luaL_error(L, "declaration failed");
+      lua_insert(L, -2);                            /* ..., syms, [col...], col, key */
+      j++;
+    }                                               /* ..., syms, col... */
+  }
+  base = 5;
+  top = lua_gettop(L);
+
+  for (i = 1; i <= n; i++){
+    lua_rawgeti(L, 2, i);                           /* ..., tname */
+    lua_rawgeti(L, 3, i);                           /* ..., tname, hname */
+    if (!lua_isstring(L, -2) || !lua_isstring(L, -1))
+      return luaL_error(L, "invalid node name at index %d", i);
+    tail = agnode(ud->g, (char *) lua_tostring(L, -2), 1);
+    head = agnode(ud->g, (char *) lua_tostring(L, -1), 1);
+    if (tail == NULL || head == NULL)
+      return luaL_error(L, "agnode failed at index %d", i);
+    if ((e = agedge(ud->g, tail, head, NULL, 0)) == NULL){
+      if ((e = agedge(ud->g, tail, head, NULL, 1)) == NULL)
+        return luaL_error(L, "agedge failed at index %d", i);
+      count++;
+    }
+    for (j = 0; j < nattr; j++){
+      lua_rawgeti(L, base + 1 + j, i);              /* ..., value */
+      if (!lua_isnil(L, -1)){
+        if (nums[j] != NULL)
+          numattr_store(L, nums[j], e, -1);
+        else if (!lua_isstring(L, -1))
+          return luaL_error(L, "invalid attribute value at index %d", i);
+        else
+          agxset(e, syms[j], (char *) lua_tostring(L, -1));
+      }
+      lua_pop(L, 1);
+    }
+    lua_settop(L, top);
+  }
+  lua_pushnumber(L, count);
+  return 1;
+}
+
 /*-------------------------------------------------------------------------*\
  * Method: n, err = g.findedge(self, tail, head [, name])
  * Finds an edge of given name between given nodes. 
@@ -1166,8 +1566,7 @@ static int gr_findedge(lua_State *L)
         edge->name = strdup(sbuf);
         edge->type = AGEDGE;
         edge->status = ALIVE;
-        set_object(L, e);                              /* ud, peer, name, edge */
-        new_edge(L);
+        new_edge(L);                                   /* ud, peer, name, edge */
         lua_pushlightuserdata(L, tail);
         lua_pushlightuserdata(L, head);
         return 3;
@@ -1202,7 +1601,7 @@ static int gr_idnode(lua_State *L)
   gr_graph_t *ud = tograph(L, 1, STRICT);
   unsigned long id = (unsigned long) luaL_checknumber(L, 2);
   if ((n = agidnode(ud->g, id, 0)) != NULL){
-    return get_object(L, n);
+    return push_object(L, n);
   } else {
     lua_pushnil(L);
     lua_pushstring(L, "agidnode failed");
@@ -1250,7 +1649,6 @@ static int gr_nextnode(lua_State *L)
       ud_n->name = strdup(agnameof(n));
       ud_n->type = AGNODE;
       ud_n->status = ALIVE;
-      set_object(L, n);
       return new_node(L);
     }
   }
@@ -1270,6 +1668,125 @@ static int gr_walknodes(lua_State *L)
   return 3;
 }
 
+/*-------------------------------------------------------------------------*\
+ * Method: t = g.nodenames(self)
+ * Retrieves the names of all nodes of a graph in one call. No node
+ * userdata is created.
+ * Returns an array of names in node sequence order.
+ * Example:
+ * t = g:nodenames()
+\*-------------------------------------------------------------------------*/
+static int gr_nodenames(lua_State *L)
+{
+  int i = 1;
+  Agnode_t *n;
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+
+  lua_createtable(L, agnnodes(ud->g), 0);           /* ud, t */
+  for (n = agfstnode(ud->g); n; n = agnxtnode(ud->g, n)){
+    lua_pushstring(L, agnameof(n));                 /* ud, t, name */
+    lua_rawseti(L, -2, i++);                        /* ud, t */
+  }
+  return 1;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Method: t = g.nodeids(self)
+ * Retrieves the ids of all nodes of a graph in one call. No node userdata
+ * is created.
+ * Returns an array of ids in node sequence order.
+ * Example:
+ * t = g:nodeids()
+\*-------------------------------------------------------------------------*/
+static int gr_nodeids(lua_State *L)
+{
+  int i = 1;
+  Agnode_t *n;
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+
+  lua_createtable(L, agnnodes(ud->g), 0);           /* ud, t */
+  for (n = agfstnode(ud->g); n; n = agnxtnode(ud->g, n)){
+#if LUA_VERSION_NUM >= 503
+    lua_pushinteger(L, (lua_Integer) AGID(n));      /* ud, t, id */
+#else
+    lua_pushnumber(L, (lua_Number) AGID(n));        /* ud, t, id */
+#endif
+    lua_rawseti(L, -2, i++);                        /* ud, t */
+  }
+  return 1;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Method: t = g.nodes(self)
+ * Retrieves all nodes of a graph in one call.
+ * Returns an array of node userdata in node sequence order.
+ * Example:
+ * t = g:nodes()
+\*-------------------------------------------------------------------------*/
+static int gr_nodes(lua_State *L)
+{
+  int i = 1;
+  Agnode_t *n;
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+
+  lua_createtable(L, agnnodes(ud->g), 0);           /* ud, t */
+  for (n = agfstnode(ud->g); n; n = agnxtnode(ud->g, n)){
+    push_object(L, n);                              /* ud, t, n */
+    lua_rawseti(L, -2, i++);                        /* ud, t */
+  }
+  return 1;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Method: id, name = nextnodeid(self, prev)
+ * Retrieves id and name of the next node in a graph without creating 
+ * node userdata. With nil as parameter prev the first node is returned.
+ * Example:
+ * id, name = g:nextnodeid(nil)
+ * id, name = g:nextnodeid(id)
+\*-------------------------------------------------------------------------*/
+static int gr_nextnodeid(lua_State *L)
+{
+  Agnode_t *n;
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+
+  if (lua_isnil(L, 2))
+    n = agfstnode(ud->g);
+#if LUA_VERSION_NUM >= 503
+  else if ((n = agidnode(ud->g, (unsigned long) luaL_checkinteger(L, 2), 0)) != NULL)
+#else
+  else if ((n = agidnode(ud->g, (unsigned long) luaL_checknumber(L, 2), 0)) != NULL)
+#endif
+    n = agnxtnode(ud->g, n);
+  if (!n){
+    /* no more nodes */
+    lua_pushnil(L);
+    return 1;
+  }
+#if LUA_VERSION_NUM >= 503
+  lua_pushinteger(L, (lua_Integer) AGID(n));
+#else
+  lua_pushnumber(L, (lua_Number) AGID(n));
+#endif
+  lua_pushstring(L, agnameof(n));
+  return 2;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Iterator: walknodeids()
+ * Iterator over id and name of all nodes of a given graph. No node 
+ * userdata is created.
+ * Example:
+ * for id, name in g:walknodeids() do ... end
+\*-------------------------------------------------------------------------*/
+static int gr_walknodeids(lua_State *L)
+{
+  lua_pushcfunction(L, gr_nextnodeid);   /* ud, nextnodeid */
+  lua_pushvalue(L, -2);                  /* ud, nextnodeid, g */
+  lua_pushnil(L);                        /* ud, nextnodeid, g, nil */
+  return 3;
+}
+
 /*-------------------------------------------------------------------------*\
  * Property: g.graph [userdata]
  * Retrieves the graph to which given subgraph belongs. Trivial because it 
@@ -1287,7 +1804,7 @@ int gr_graphof(lua_State *L)
     lua_pushstring(L, "no graph");
     return 2;
   }
-  return get_object(L, ud->g);
+  return push_object(L, ud->g);
 }
 
 /*-------------------------------------------------------------------------*\
@@ -1318,20 +1835,19 @@ int gr_contains(lua_State *L)
  * b = g:layout("dot")
 \*-------------------------------------------------------------------------*/
 static int gr_layout(lua_State *L)
+{
+  return layout(L, curcontext(L));
+}
+
+static int layout(lua_State *L, GVC_t *ctx)
 {
   int rv;
   gr_graph_t *ud = tograph(L, 1, STRICT);
   char *fmt = (char *) luaL_optstring(L, 2, "dot");
 
-  if (!strcmp(fmt, "dot") ||
-      !strcmp(fmt, "neato") ||
-      !strcmp(fmt, "nop") ||
-      !strcmp(fmt, "nop2") ||
-      !strcmp(fmt, "twopi") ||
-      !strcmp(fmt, "fdp") ||
-      !strcmp(fmt, "circo")){
+  if (gv_isengine(fmt)){
 
-    if ((rv = gv_layout(ud->g, fmt)) != GR_SUCCESS){
+    if ((rv = gv_layout(L, ctx, ud->g, fmt)) != GR_SUCCESS){
       luaL_error(L, "layout error: %d", rv);
       return 0;
     }
@@ -1350,10 +1866,15 @@ static int gr_layout(lua_State *L)
  * b = g:freelayout()
 \*-------------------------------------------------------------------------*/
 static int gr_freelayout(lua_State *L)
+{
+  return freelayout(L, curcontext(L));
+}
+
+static int freelayout(lua_State *L, GVC_t *ctx)
 {
   gr_graph_t *ud = tograph(L, 1, STRICT);
   if (ud->g)
-    gv_free_layout(ud->g);
+    gv_free_layout(ctx, ud->g);
   else {
     lua_pushnil(L);
     lua_pushstring(L, "invalid graph");
@@ -1369,25 +1890,30 @@ static int gr_freelayout(lua_State *L)
  * b = g:render("pdf")
 \*-------------------------------------------------------------------------*/
 static int gr_render(lua_State *L)
+{
+  return render(L, curcontext(L));
+}
+
+static int render(lua_State *L, GVC_t *ctx)
 {
   int rv;
   gr_graph_t *ud = tograph(L, 1, STRICT);
   char *rfmt = (char *) luaL_optstring(L, 2, "plain");
   char *fname = (char *) luaL_optstring(L, 3, NULL);
   char *lfmt = (char *) luaL_optstring(L, 4, NULL);
-  if (gvc == NULL){
+  if (ctx == NULL){
     lua_pushnil(L);
     lua_pushstring(L, "layout missing");
     return 2;
   }
   if (lfmt)
-    gv_layout(ud->g, lfmt);
+    gv_layout(L, ctx, ud->g, lfmt);
   if (fname)
-    rv = gv_render_file(ud->g, rfmt, fname);
+    rv = gv_render_file(ctx, ud->g, rfmt, fname);
   else
-    rv = gv_render(ud->g, rfmt, stdout);
+    rv = gv_render(ctx, ud->g, rfmt, stdout);
   if (lfmt)
-    gv_free_layout(ud->g);
+    gv_free_layout(ctx, ud->g);
   if (rv != GR_SUCCESS){
     lua_pushnil(L);
     lua_pushstring(L, "gvRender failed");
@@ -1397,6 +1923,136 @@ static int gr_render(lua_State *L)
   return 1;
 }
 
+/*-------------------------------------------------------------------------*\
+ * Method: s, err = g.renderdata(self, rfmt [, lfmt [, chunksize]])
+ * Render the given graph in the specified format into memory - no files
+ * involved. Returns the rendered data as Lua string. If chunksize is given,
+ * the data is returned as a sequence (table) of strings with at most 
+ * chunksize bytes each.
+ * Example:
+ * s = g:renderdata("svg", "dot")
+ * t = g:renderdata("svg", nil, 65536)
+\*-------------------------------------------------------------------------*/
+static int gr_renderdata(lua_State *L)
+{
+  return renderdata(L, curcontext(L));
+}
+
+static int renderdata(lua_State *L, GVC_t *ctx)
+{
+  int rv, i;
+  char *data = NULL;
+  gv_datalen_t len = 0;
+  size_t pos, chunk;
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+  char *rfmt = (char *) luaL_optstring(L, 2, "plain");
+  char *lfmt = (char *) luaL_optstring(L, 3, NULL);
+  size_t chunksize = (size_t) luaL_optnumber(L, 4, 0);
+
+  if (lfmt)
+    gv_layout(L, ctx, ud->g, lfmt);
+  rv = gv_render_data(ctx, ud->g, rfmt, &data, &len);
+  if (lfmt)
+    gv_free_layout(ctx, ud->g);
+  if (rv != GR_SUCCESS){
+    if (data)
+      gvFreeRenderData(data);
+    lua_pushnil(L);
+    lua_pushstring(L, "gvRenderData failed");
+    return 2;
+  }
+  if (chunksize == 0){
+    lua_pushlstring(L, data, len);                 /* ud, ..., s */
+  } else {
+    lua_newtable(L);                               /* ud, ..., t */
+    for (pos = 0, i = 1; pos < len; pos += chunk, i++){
+      chunk = (len - pos < chunksize) ? len - pos : chunksize;
+      lua_pushlstring(L, data + pos, chunk);       /* ud, ..., t, s */
+      lua_rawseti(L, -2, i);                       /* ud, ..., t */
+    }
+  }
+  gvFreeRenderData(data);
+  return 1;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Method: t, err = g.renderall(self, options)
+ * Render the graph into several formats from a single layout. Options is
+ * a table with the fields:
+ *   formats:  array of output formats
+ *   engine:   layout engine; layout is done before and freed after
+ *             rendering. Without engine the current layout is used.
+ *   basename: render into files basename.<format> instead of memory
+ * Returns a table with the rendered data - or the file names - keyed by
+ * format on success, nil plus error message otherwise.
+ * Example:
+ * t = g:renderall{engine = "dot", formats = {"svg", "png", "cmapx"}}
+ * io.write(t.svg)
+\*-------------------------------------------------------------------------*/
+static int gr_renderall(lua_State *L)
+{
+  int i, n, rv = GR_SUCCESS;
+  char *data;
+  gv_datalen_t len;
+  const char *fmt = NULL, *colon;
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+  GVC_t *ctx = curcontext(L);
+  const char *engine, *base;
+
+  luaL_checktype(L, 2, LUA_TTABLE);
+  lua_settop(L, 2);
+  engine = optstrfield(L, 2, "engine");
+  base = optstrfield(L, 2, "basename");
+  if (engine != NULL && !gv_isengine(engine))
+    return luaL_error(L, "invalid layout format '%s'", engine);
+  lua_getfield(L, 2, "formats");                 /* ud, opt, formats */
+  luaL_argcheck(L, lua_istable(L, 3), 2, "field 'formats' (array expected)");
+  n = (int) lua_rawlen(L, 3);
+  for (i = 1; i <= n; i++){
+    lua_rawgeti(L, 3, i);
+    if (!lua_isstring(L, -1))
+      return luaL_error(L, "bad field 'formats' (array of strings expected)");
+    lua_pop(L, 1);
+  }
+  lua_createtable(L, 0, n);                      /* ud, opt, formats, t */
+  if (engine != NULL && gv_layout(L, ctx, ud->g, engine) != GR_SUCCESS){
+    lua_pushnil(L);
+    lua_pushstring(L, "layout failed");
+    return 2;
+  }
+  for (i = 1; i <= n; i++){
+    lua_rawgeti(L, 3, i);                        /* ud, opt, formats, t, fmt */
+    fmt = lua_tostring(L, -1);
+    if (base != NULL){
+      colon = strchr(fmt, ':');
+      lua_pushfstring(L, "%s.", base);           /* ..., t, fmt, fname */
+      lua_pushlstring(L, fmt, colon ? (size_t)(colon - fmt) : strlen(fmt));
+      lua_concat(L, 2);
+      rv = gv_render_file(ctx, ud->g, fmt, lua_tostring(L, -1));
+    } else {
+      data = NULL;
+      len = 0;
+      rv = gv_render_data(ctx, ud->g, fmt, &data, &len);
+      if (rv == GR_SUCCESS)
+        lua_pushlstring(L, data, len);           /* ..., t, fmt, s */
+      if (data)
+        gvFreeRenderData(data);
+    }
+    if (rv != GR_SUCCESS)
+      break;
+    lua_setfield(L, 4, fmt);                     /* ud, opt, formats, t, fmt */
+    lua_pop(L, 1);                               /* ud, opt, formats, t */
+  }
+  if (engine != NULL)
+    gv_free_layout(ctx, ud->g);
+  if (rv != GR_SUCCESS){
+    lua_pushnil(L);
+    lua_pushfstring(L, "cannot render '%s'", fmt);
+    return 2;
+  }
+  return 1;
+}
+
 /*-------------------------------------------------------------------------*\
  * Method: list, count = graph.plugins(type)
  * Retrieve available plugins for layout or rendering.
@@ -1405,16 +2061,23 @@ static int gr_render(lua_State *L)
  * tab, err  = g:layout("layout")
 \*-------------------------------------------------------------------------*/
 static int gr_plugins(lua_State *L)
+{
+  return plugins(L, curcontext(L));
+}
+
+static int plugins(lua_State *L, GVC_t *ctx)
 {
   int i, count;
   char **list;
 
   char *kind = (char *) luaL_optstring(L, 1, "render");
+  gv_lock();
 #if 1
-  list = gvPluginList(gvc, kind, &count, NULL);
+  list = gvPluginList(ctx, kind, &count, NULL);
 #else
-  list = gvPluginList(gvc, kind, &count);
+  list = gvPluginList(ctx, kind, &count);
 #endif
+  gv_unlock();
   if (list == NULL){
     lua_pushnil(L);
     lua_pushstring(L, "no plugins");
@@ -1433,6 +2096,129 @@ static int gr_plugins(lua_State *L)
   free(list);
   return 2;
 }
+/*-------------------------------------------------------------------------*\
+ * Function: ctx, err = graph.context([makedefault])
+ * Create a Graphviz context of its own with all plugins. A context
+ * isolates plugin state and render jobs from other contexts, e.g. of
+ * other Lua states of the process. It does not make anything faster:
+ * layout and rendering use global state of Graphviz and are serialized
+ * for all contexts, so several contexts never work in parallel. Use
+ * graph.batchrender() to lay out graphs on several cores.
+ * If makedefault is true, the context is used by g:layout(), g:render(),
+ * g:renderdata() and graph.plugins() of this Lua state instead of the
+ * process wide default context.
+ * Free all layouts made with a context before closing it.
+ * Returns the context on success, nil plus error message otherwise.
+ * Context methods:
+ *   ctx:layout(g, engine), ctx:freelayout(g), ctx:render(g, ...),
+ *   ctx:renderdata(g, ...), ctx:plugins(type) - like the graph methods
+ *   ctx:close() - release the context
+ * Example:
+ * ctx = graph.context()
+ * ctx:layout(g, "dot")
+ * s = ctx:renderdata(g, "svg")
+ * ctx:freelayout(g)
+ * ctx:close()
+\*-------------------------------------------------------------------------*/
+static int gr_context(lua_State *L)
+{
+  int makedefault = lua_toboolean(L, 1);
+  gr_context_t *ctx = (gr_context_t *) lua_newuserdata(L, sizeof(gr_context_t));
+
+  ctx->gvc = NULL;
+  luaL_getmetatable(L, "graph.context");         /* ..., ctx, mt */
+  lua_setmetatable(L, -2);                       /* ..., ctx */
+  gv_lock();
+  ctx->gvc = gv_context();
+  gv_unlock();
+  if (ctx->gvc == NULL){
+    lua_pushnil(L);
+    lua_pushstring(L, "cannot load plugins");
+    return 2;
+  }
+  if (makedefault){
+    lua_pushvalue(L, -1);                        /* ..., ctx, ctx */
+    lua_setfield(L, LUA_REGISTRYINDEX, CONTEXT_DEFAULT);
+  }
+  return 1;
+}
+
+/*
+ * Context used by the graph methods of this Lua state.
+ */
+static GVC_t *curcontext(lua_State *L)
+{
+  gr_context_t *ctx;
+
+  lua_getfield(L, LUA_REGISTRYINDEX, CONTEXT_DEFAULT);
+  ctx = (gr_context_t *) lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  return (ctx != NULL && ctx->gvc != NULL) ? ctx->gvc : gvc;
+}
+
+/*
+ * Check for an open context as first argument and remove it from the
+ * stack. Context methods are the graph methods on the remaining arguments.
+ */
+static GVC_t *tocontext(lua_State *L)
+{
+  gr_context_t *ctx = (gr_context_t *) luaL_checkudata(L, 1, "graph.context");
+
+  if (ctx->gvc == NULL)
+    luaL_error(L, "bad argument #1 (context closed)");
+  lua_remove(L, 1);
+  return ctx->gvc;
+}
+
+static int ctx_layout(lua_State *L)
+{
+  GVC_t *ctx = tocontext(L);
+  return layout(L, ctx);
+}
+
+static int ctx_freelayout(lua_State *L)
+{
+  GVC_t *ctx = tocontext(L);
+  return freelayout(L, ctx);
+}
+
+static int ctx_render(lua_State *L)
+{
+  GVC_t *ctx = tocontext(L);
+  return render(L, ctx);
+}
+
+static int ctx_renderdata(lua_State *L)
+{
+  GVC_t *ctx = tocontext(L);
+  return renderdata(L, ctx);
+}
+
+static int ctx_plugins(lua_State *L)
+{
+  GVC_t *ctx = tocontext(L);
+  return plugins(L, ctx);
+}
+
+static int ctx_close(lua_State *L)
+{
+  gr_context_t *ctx = (gr_context_t *) luaL_checkudata(L, 1, "graph.context");
+
+  if (ctx->gvc == NULL)
+    return 0;
+  lua_getfield(L, LUA_REGISTRYINDEX, CONTEXT_DEFAULT);
+  if (lua_touserdata(L, -1) == (void *) ctx){
+    lua_pushnil(L);
+    lua_setfield(L, LUA_REGISTRYINDEX, CONTEXT_DEFAULT);
+  }
+  lua_pop(L, 1);
+  gv_lock();
+  gvFreeContext(ctx->gvc);
+  gv_unlock();
+  ctx->gvc = NULL;
+  return 0;
+}
+
 /*-------------------------------------------------------------------------*\
  * Module initialization
 \*-------------------------------------------------------------------------*/
@@ -1462,9 +2248,26 @@ LUALIB_API int luaopen_graph_core(lua_State *L) {
   lua_pushliteral(L, "plugins");
   lua_pushcfunction(L, gr_plugins);
   lua_rawset(L, -3);
-  if ((gvc = gvContextPlugins(lt_preloaded_symbols, DEMAND_LOADING)) == NULL){
+  /* The default context is shared by all Lua states of the process */
+  gv_lock();
+  if (gvc == NULL)
+    gvc = gv_context();
+  gv_unlock();
+  if (gvc == NULL){
     return luaL_error(L, "cannot load plugins");
   }
+  /* Metatables are shared by all proxies of a kind */
+  init_graph(L);
+  init_node(L);
+  init_edge(L);
+  luaL_newmetatable(L, "graph.reader");
+  register_metainfo(L, reg_reader_metamethods);
+  lua_pop(L, 1);
+  luaL_newmetatable(L, "graph.context");
+  register_metainfo(L, reg_context_methods);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
   return 1;
 }
 
@@ -31,6 +31,15 @@
 #define TRUE (1)
 #endif
 
+/*
+ * Length parameter of gvRenderData(): size_t since graphviz 9
+ */
+#ifdef GV_RENDERDATA_SIZE_T
+typedef size_t gv_datalen_t;
+#else
+typedef unsigned int gv_datalen_t;
+#endif
+
 #define ALIVE (1)
 #define DEAD  (0)
 
@@ -98,9 +107,7 @@ typedef int (index_handler_t)(lua_State *L);
 /*
  * Callback functions
  */
-void cb_insert(struct Agraph_s *g, struct Agobj_s *obj, void *L);
 void cb_delete(Agraph_t *g, Agobj_t *obj, void *L);
-void cb_modify(Agraph_t *g, Agobj_t *obj, void *L, Agsym_t *sym);
 
 /*
  * Helper for auto naming.
@@ -118,21 +125,118 @@ gr_object_t *toobject(lua_State *L, int narg, const char *type, int strict);
 #define register_metainfo(L, f) luaL_setfuncs(L, f, 0)
 #else
 #define register_metainfo(L, f) luaL_register(L, NULL, f)
+#define lua_rawlen(L, i) lua_objlen(L, i)
+#define lua_absindex(L, i) \
+  (((i) > 0 || (i) <= LUA_REGISTRYINDEX) ? (i) : lua_gettop(L) + (i) + 1)
 #endif
 
 int set_object(lua_State *L, void *key);
 int get_object(lua_State *L, void *key);
+int push_object(lua_State *L, void *key);
 int del_object(lua_State *L, void *key);
+void del_cache(lua_State *L, void *root);
+void del_fields(lua_State *L, void *obj);
+
+/*
+ * DOT input from Lua file handles, reader functions and strings
+ */
+Agraph_t *read_graph(lua_State *L, int idx);
+
+/*
+ * DOT output into Lua strings and sink functions
+ */
+int write_string(lua_State *L, Agraph_t *g);
+int write_sink(lua_State *L, Agraph_t *g, int sink);
+
+/*
+ * Binary snapshots
+ */
+int save_graph(Agraph_t *g, const char *fname, const char **err);
+Agraph_t *load_graph(const char *fname, const char **err);
+
+/*
+ * Graph algorithms
+ */
+int gr_csr(lua_State *L);
+int gr_shortestpaths(lua_State *L);
+int gr_path(lua_State *L);
+int gr_scc(lua_State *L);
+int gr_toposort(lua_State *L);
+int gr_components(lua_State *L);
+int gr_pagerank(lua_State *L);
+int gr_betweenness(lua_State *L);
+
+/*
+ * Option tables
+ */
+double optnumfield(lua_State *L, int idx, const char *name, double def);
+const char *optstrfield(lua_State *L, int idx, const char *name);
+
+/*
+ * Layout results
+ */
+int gr_positions(lua_State *L);
+int gr_splines(lua_State *L);
+
+/*
+ * Layout cache
+ */
+int gr_layoutcache(lua_State *L);
+int lcache_layout(lua_State *L, GVC_t *gvc, Agraph_t *g, const char *engine);
+
+/*
+ * Graphviz contexts and background layout
+ */
+GVC_t *gv_context(void);
+int gv_isengine(const char *engine);
+void gv_lock(void);
+void gv_unlock(void);
+int async_busy(void *obj);
+int gr_layout_async(lua_State *L);
+
+/*
+ * Batch rendering
+ */
+int gr_batchrender(lua_State *L);
+
+/*
+ * Attribute access
+ */
+int tokind(lua_State *L, int narg);
+int gr_attrsym(lua_State *L);
+int gr_getcolumn(lua_State *L);
+int gr_setcolumn(lua_State *L);
+
+/*
+ * Numeric attributes
+ */
+typedef struct gr_numattr_s gr_numattr_t;
+int gr_declare_numeric(lua_State *L);
+gr_numattr_t *numattr_find(void *obj, int kind, const char *name);
+int numattr_get(gr_numattr_t *a, void *obj, double *v);
+int numattr_set(gr_numattr_t *a, void *obj, double v);
+void numattr_store(lua_State *L, gr_numattr_t *a, void *obj, int idx);
+int numattr_index(lua_State *L, void *obj, const char *name);
+int numattr_newindex(lua_State *L);
+void numattr_sync(Agraph_t *g);
+void del_numattrs(Agraph_t *root);
 
 /*
  * Graph object creation
  */
-int new_object(lua_State *L, const char *kind, const luaL_Reg *reg_rmembers, 
-	       const luaL_Reg *reg_methods, const luaL_Reg *reg_metamethods,
-	       index_handler_t *index_handler);
+int new_metatable(lua_State *L, const char *kind, const luaL_Reg *reg_rmembers, 
+                  const luaL_Reg *reg_methods, const luaL_Reg *reg_metamethods,
+                  index_handler_t *index_handler);
+int new_object(lua_State *L, const char *kind);
 int new_edge(lua_State *L);
 int new_node(lua_State *L);
 
+/*
+ * Metatable creation - once per kind at module initialization
+ */
+int init_edge(lua_State *L);
+int init_node(lua_State *L);
+
 /*
  * __index, __newindex metamethod handlers
  */
@@ -0,0 +1,321 @@
+/*=========================================================================*\
+ * LuaGRAPH toolkit
+ * Graph support for Lua.
+ * Herbert Leuwer
+ * 30-7-2006, 01/2017
+ *
+ * I/O disciplines: exchange DOT text with Lua instead of files.
+ *
+\*=========================================================================*/
+
+/*=========================================================================*\
+ * Includes
+\*=========================================================================*/
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "gr_graph.h"
+
+/*=========================================================================*\
+ * Defines
+\*=========================================================================*/
+#define SINKBUFSIZE (64*1024)
+
+/*=========================================================================*\
+ * Data
+\*=========================================================================*/
+/*
+ * Input channel used by the read discipline. Input comes either from a
+ * Lua string or - chunk by chunk - from a Lua reader function.
+ */
+struct gr_reader_s {
+  lua_State *L;
+  int func;           /* stack index of reader function or 0 */
+  int slot;           /* stack index anchoring the current chunk */
+  const char *s;      /* current chunk */
+  size_t len;
+  size_t pos;
+  int error;          /* reader raised an error: message in slot */
+};
+typedef struct gr_reader_s gr_reader_t;
+
+/*
+ * Output channel used by the write discipline. The whole output is
+ * collected in C memory: cgraph's writer keeps its state in statics, so no
+ * Lua code - which might write another graph - may run during agwrite().
+ */
+struct gr_writer_s {
+  char *buf;
+  size_t n;
+  size_t size;
+  int error;          /* out of memory */
+};
+typedef struct gr_writer_s gr_writer_t;
+
+/*=========================================================================*\
+ * Functions
+\*=========================================================================*/
+/*-------------------------------------------------------------------------*\
+ * Read discipline
+\*-------------------------------------------------------------------------*/
+/*
+ * Fetch the next chunk from the reader function. Returns 0 at end of input.
+ */
+static int rd_fetch(gr_reader_t *r)
+{
+  lua_State *L = r->L;
+
+  if (r->func == 0 || r->error)
+    return 0;
+  lua_pushvalue(L, r->func);                 /* ..., func */
+  if (lua_pcall(L, 0, 1, 0) != 0){           /* ..., err */
+    r->error = 1;
+    lua_replace(L, r->slot);
+    return 0;
+  }
+  if (lua_isnil(L, -1)){                     /* ..., chunk */
+    lua_pop(L, 1);
+    r->func = 0;
+    return 0;
+  }
+  if (lua_type(L, -1) != LUA_TSTRING){
+    lua_pop(L, 1);
+    lua_pushstring(L, "reader function must return a string");
+    lua_replace(L, r->slot);
+    r->error = 1;
+    return 0;
+  }
+  r->s = lua_tolstring(L, -1, &r->len);
+  r->pos = 0;
+  lua_replace(L, r->slot);
+  if (r->len == 0)
+    r->func = 0;
+  return r->len;
+}
+
+static int rd_read(void *chan, char *buf, int bufsize)
+{
+  gr_reader_t *r = (gr_reader_t *) chan;
+  size_t n;
+
+  if (r->pos >= r->len && rd_fetch(r) == 0)
+    return 0;
+  n = r->len - r->pos;
+  if (n > (size_t) bufsize)
+    n = bufsize;
+  memcpy(buf, r->s + r->pos, n);
+  r->pos += n;
+  return (int) n;
+}
+
+/*
+ * The discipline stays with the graph after reading: output goes to a 
+ * FILE like with cgraph's default discipline.
+ */
+static int rd_putstr(void *chan, const char *str)
+{
+  return fputs(str, (FILE *) chan);
+}
+
+static int rd_flush(void *chan)
+{
+  return fflush((FILE *) chan);
+}
+
+static Agiodisc_t readiodisc = {rd_read, rd_putstr, rd_flush};
+#ifdef GV_NO_MEMDISC
+static Agdisc_t readdisc = {&AgIdDisc, &readiodisc};
+#else
+static Agdisc_t readdisc = {&AgMemDisc, &AgIdDisc, &readiodisc};
+#endif
+
+/*
+ * Return the FILE of the open Lua io file handle at stack index idx or NULL.
+ */
+static FILE *tofile(lua_State *L, int idx)
+{
+#if LUA_VERSION_NUM >= 502
+  luaL_Stream *p = (luaL_Stream *) luaL_testudata(L, idx, LUA_FILEHANDLE);
+  return (p != NULL && p->closef != NULL) ? p->f : NULL;
+#else
+  FILE **pf = NULL;
+  if (lua_getmetatable(L, idx)){
+    luaL_getmetatable(L, LUA_FILEHANDLE);
+    if (lua_rawequal(L, -1, -2))
+      pf = (FILE **) lua_touserdata(L, idx);
+    lua_pop(L, 2);
+  }
+  return (pf != NULL) ? *pf : NULL;
+#endif
+}
+
+/*
+ * Read a graph in DOT notation from the source at stack index idx: an open
+ * Lua io file handle, a reader function returning successive chunks of 
+ * text (nil or "" at the end) or a string. Errors raised by the reader are
+ * propagated.
+ * Returns the graph or NULL.
+ */
+Agraph_t *read_graph(lua_State *L, int idx)
+{
+  Agraph_t *g;
+  FILE *f;
+  gr_reader_t r;
+
+  idx = lua_absindex(L, idx);
+  if (lua_isuserdata(L, idx)){
+    if ((f = tofile(L, idx)) == NULL)
+      return NULL;
+    return agread(f, NULL);
+  }
+  memset(&r, 0, sizeof(r));
+  r.L = L;
+  if (lua_isfunction(L, idx))
+    r.func = idx;
+  else if (lua_type(L, idx) == LUA_TSTRING)
+    r.s = lua_tolstring(L, idx, &r.len);
+  else
+    return NULL;
+  lua_pushnil(L);                            /* ..., slot */
+  r.slot = lua_gettop(L);
+  g = agread(&r, &readdisc);
+  if (r.error){
+    if (g != NULL)
+      agclose(g);
+    lua_error(L);                            /* ..., err */
+  }
+  lua_pop(L, 1);                             /* ... */
+  return g;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Write discipline
+\*-------------------------------------------------------------------------*/
+static int wr_read(void *chan, char *buf, int bufsize)
+{
+  return 0;
+}
+
+static int wr_flush(void *chan)
+{
+  return ((gr_writer_t *) chan)->error ? EOF : 0;
+}
+
+static int wr_putstr(void *chan, const char *str)
+{
+  gr_writer_t *w = (gr_writer_t *) chan;
+  size_t len = strlen(str);
+  size_t size;
+  char *buf;
+
+  if (w->error)
+    return EOF;
+  if (w->n + len > w->size){
+    for (size = (w->size > 0) ? w->size : SINKBUFSIZE; size < w->n + len; size *= 2)
+      ;
+    if ((buf = realloc(w->buf, size)) == NULL){
+      w->error = 1;
+      return EOF;
+    }
+    w->buf = buf;
+    w->size = size;
+  }
+  memcpy(w->buf + w->n, str, len);
+  w->n += len;
+  return 0;
+}
+
+static Agiodisc_t writedisc = {wr_read, wr_putstr, wr_flush};
+
+/*
+ * Write graph g into w through the write discipline. The io discipline of
+ * the graph is replaced only for the duration of agwrite().
+ * Returns 0 on success; w->buf must then be freed by the caller.
+ */
+static int write_graph(Agraph_t *g, gr_writer_t *w)
+{
+  int rv;
+  Agiodisc_t *io = g->clos->disc.io;
+
+  memset(w, 0, sizeof(gr_writer_t));
+  g->clos->disc.io = &writedisc;
+  rv = agwrite(g, w);
+  g->clos->disc.io = io;
+  if (rv == 0 && w->error)
+    rv = EOF;
+  if (rv){
+    free(w->buf);
+    w->buf = NULL;
+  }
+  return rv;
+}
+
+/*
+ * Write a graph in DOT notation into a Lua string.
+ * Lua exit stack: ?, s or nil, err
+ */
+int write_string(lua_State *L, Agraph_t *g)
+{
+  gr_writer_t w;
+
+  if (write_graph(g, &w)){
+    lua_pushnil(L);
+    lua_pushstring(L, "agwrite failed");
+    return 2;
+  }
+  lua_pushlstring(L, (w.buf != NULL) ? w.buf : "", w.n);   /* ?, s */
+  free(w.buf);
+  return 1;
+}
+
+/*
+ * Pass the text of w to the sink in chunks of SINKBUFSIZE bytes. Runs
+ * protected, so that the caller can free the text on errors.
+ * Lua stack: sink, w
+ */
+static int wr_sinkall(lua_State *L)
+{
+  gr_writer_t *w = (gr_writer_t *) lua_touserdata(L, 2);
+  size_t pos, n;
+
+  for (pos = 0; pos < w->n; pos += n){
+    n = (w->n - pos > SINKBUFSIZE) ? SINKBUFSIZE : w->n - pos;
+    lua_pushvalue(L, 1);                     /* sink, w, sink */
+    lua_pushlstring(L, w->buf + pos, n);     /* sink, w, sink, chunk */
+    lua_call(L, 1, 0);                       /* sink, w */
+  }
+  return 0;
+}
+
+/*
+ * Write a graph in DOT notation to the sink function at stack index sink.
+ * The sink is called with one chunk of text per call once the graph has
+ * been written, so it may write graphs itself. Errors raised by the sink
+ * are propagated.
+ * Lua exit stack: ?, n or nil, err
+ */
+int write_sink(lua_State *L, Agraph_t *g, int sink)
+{
+  gr_writer_t w;
+
+  sink = lua_absindex(L, sink);
+  if (write_graph(g, &w)){
+    lua_pushnil(L);
+    lua_pushstring(L, "agwrite failed");
+    return 2;
+  }
+  lua_pushcfunction(L, wr_sinkall);          /* ?, f */
+  lua_pushvalue(L, sink);                    /* ?, f, sink */
+  lua_pushlightuserdata(L, &w);              /* ?, f, sink, w */
+  if (lua_pcall(L, 2, 0, 0) != 0){           /* ?, [err] */
+    free(w.buf);
+    return lua_error(L);
+  }
+  free(w.buf);
+  lua_pushnumber(L, 0);
+  return 1;
+}
@@ -0,0 +1,135 @@
+/*=========================================================================*\
+ * LuaGRAPH toolkit
+ * Graph support for Lua.
+ * Herbert Leuwer
+ * 30-7-2006, 01/2017
+ *
+ * Layout results: node positions and edge splines as numbers.
+ *
+\*=========================================================================*/
+
+/*=========================================================================*\
+ * Includes
+\*=========================================================================*/
+#include <string.h>
+#include <stdlib.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "gr_graph.h"
+#include "graphviz/types.h"
+
+/*=========================================================================*\
+ * Defines
+\*=========================================================================*/
+#define POINTS_PER_INCH (72.0)
+
+/*=========================================================================*\
+ * Functions
+\*=========================================================================*/
+/*
+ * Check whether the graph has been layouted. Moves the layout record to
+ * the front so that the ND_xxx and ED_xxx macros can be used.
+ */
+static int haslayout(void *obj, const char *rec)
+{
+  return aggetrec(obj, rec, 1) != NULL;
+}
+
+static int pushnolayout(lua_State *L)
+{
+  lua_pushnil(L);
+  lua_pushstring(L, "layout missing");
+  return 2;
+}
+
+static void pushnumber(lua_State *L, int *i, double v)
+{
+  lua_pushnumber(L, v);
+  lua_rawseti(L, -2, (*i)++);
+}
+
+/*-------------------------------------------------------------------------*\
+ * Method: pos, bb = g.positions(self)
+ * Retrieves the node positions of a layouted graph without rendering.
+ * pos is a flat array with x, y, width and height of each node in the
+ * order of g:nodenames(); bb holds the lower left and upper right corner
+ * of the bounding box of the graph. All values are in points.
+ * Returns the arrays on success, nil plus error message if the graph has
+ * no layout.
+ * Example:
+ * g:layout("dot")
+ * pos, bb = g:positions()
+ * for i = 1, #pos, 4 do print(pos[i], pos[i+1], pos[i+2], pos[i+3]) end
+\*-------------------------------------------------------------------------*/
+int gr_positions(lua_State *L)
+{
+  Agnode_t *n;
+  boxf bb;
+  int i = 1;
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+  Agraph_t *root = agroot(ud->g);
+
+  if (!haslayout(root, "Agraphinfo_t"))
+    return pushnolayout(L);
+  bb = GD_bb(root);
+  lua_createtable(L, 4 * agnnodes(ud->g), 0);           /* ud, pos */
+  for (n = agfstnode(ud->g); n; n = agnxtnode(ud->g, n)){
+    if (!haslayout(n, "Agnodeinfo_t")){
+      lua_pop(L, 1);
+      return pushnolayout(L);
+    }
+    pushnumber(L, &i, ND_coord(n).x);
+    pushnumber(L, &i, ND_coord(n).y);
+    pushnumber(L, &i, ND_width(n) * POINTS_PER_INCH);
+    pushnumber(L, &i, ND_height(n) * POINTS_PER_INCH);
+  }
+  i = 1;
+  lua_createtable(L, 4, 0);                             /* ud, pos, bb */
+  pushnumber(L, &i, bb.LL.x);
+  pushnumber(L, &i, bb.LL.y);
+  pushnumber(L, &i, bb.UR.x);
+  pushnumber(L, &i, bb.UR.y);
+  return 2;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Method: t = g.splines(self)
+ * Retrieves the edge splines of a layouted graph without rendering.
+ * t holds one array per edge - edges ordered by tail node in the order of
+ * g:nodenames(), then by creation - with the flat x, y pairs of the bezier
+ * control points in points. Edges without spline get an empty array.
+ * Returns the array on success, nil plus error message if the graph has
+ * no layout.
+ * Example:
+ * g:layout("dot")
+ * for k, pts in ipairs(g:splines()) do print(k, #pts / 2) end
+\*-------------------------------------------------------------------------*/
+int gr_splines(lua_State *L)
+{
+  Agnode_t *n;
+  Agedge_t *e;
+  splines *spl;
+  bezier *bz;
+  int i, j, k, ne = 1;
+  gr_graph_t *ud = tograph(L, 1, STRICT);
+
+  if (!haslayout(agroot(ud->g), "Agraphinfo_t"))
+    return pushnolayout(L);
+  lua_createtable(L, agnedges(ud->g), 0);               /* ud, t */
+  for (n = agfstnode(ud->g); n; n = agnxtnode(ud->g, n))
+    for (e = agfstout(ud->g, n); e; e = agnxtout(ud->g, e)){
+      spl = haslayout(e, "Agedgeinfo_t") ? ED_spl(e) : NULL;
+      lua_newtable(L);                                  /* ud, t, pts */
+      for (k = 1, i = 0; spl != NULL && i < spl->size; i++){
+        bz = &spl->list[i];
+        for (j = 0; j < bz->size; j++){
+          pushnumber(L, &k, bz->list[j].x);
+          pushnumber(L, &k, bz->list[j].y);
+        }
+      }
+      lua_rawseti(L, -2, ne++);                         /* ud, t */
+    }
+  return 1;
+}
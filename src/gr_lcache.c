@@ -0,0 +1,761 @@
+/*=========================================================================*\
+ * LuaGRAPH toolkit
+ * Graph support for Lua.
+ * Herbert Leuwer
+ * 30-7-2006, 01/2017
+ *
+ * Layout cache: reuse the layout of structurally identical graphs.
+ *
+\*=========================================================================*/
+
+/*=========================================================================*\
+ * Includes
+\*=========================================================================*/
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "gr_graph.h"
+#include "graphviz/types.h"
+
+/*=========================================================================*\
+ * Defines
+\*=========================================================================*/
+#define LCACHE_STATE   "luagraph.lcache"
+#define LCACHE_ENTRIES "luagraph.lcache.entries"
+#define LCACHE_SIZE    (256)
+
+#define FNV_OFFSET ((uint64_t) 14695981039346656037ULL)
+#define FNV_PRIME  ((uint64_t) 1099511628211ULL)
+
+/*=========================================================================*\
+ * Data
+\*=========================================================================*/
+/*
+ * Cache configuration and statistics - one per Lua state.
+ */
+struct lcache_s {
+  int enabled;
+  int maxentries;
+  int nentries;
+  char *dir;                /* cache directory or NULL */
+  unsigned long hits;
+  unsigned long misses;
+};
+typedef struct lcache_s lcache_t;
+
+/*
+ * Attributes written by layout and rendering: not part of the hash.
+ */
+static const char *outattrs[] = {
+  "pos", "bb", "lp", "xlp", "head_lp", "tail_lp", "lwidth", "lheight", "rects",
+  "_draw_", "_ldraw_", "_hdraw_", "_tdraw_", "_hldraw_", "_tldraw_",
+  "_background", "xdotversion", "__attrib__", NULL
+};
+
+/*
+ * Hash state: relevant attribute symbols and node/edge numbering.
+ */
+struct lhash_s {
+  uint64_t h;
+  Agsym_t **syms[3];
+  int nsyms[3];
+  int *nidx;
+  int *eidx;
+  int bypass;               /* graph has input positions: don't cache */
+};
+typedef struct lhash_s lhash_t;
+
+/*
+ * Attribute values replaced while applying a cached layout.
+ */
+struct lsaved_s {
+  void *obj;
+  Agsym_t *sym;
+  char *old;
+};
+typedef struct lsaved_s lsaved_t;
+
+static int lcache_collect(lua_State *L);
+static const luaL_Reg reg_lcache_metamethods[] = {
+  {"__gc", lcache_collect},
+  {NULL, NULL}
+};
+
+/*=========================================================================*\
+ * Functions
+\*=========================================================================*/
+/*-------------------------------------------------------------------------*\
+ * Cache state
+\*-------------------------------------------------------------------------*/
+static int lcache_collect(lua_State *L)
+{
+  lcache_t *lc = (lcache_t *) lua_touserdata(L, 1);
+  free(lc->dir);
+  lc->dir = NULL;
+  return 0;
+}
+
+/*
+ * Retrieve the cache state of this Lua state; created on first use.
+ */
+static lcache_t *lcache_get(lua_State *L)
+{
+  lcache_t *lc;
+
+  lua_getfield(L, LUA_REGISTRYINDEX, LCACHE_STATE);        /* ..., lc */
+  if (lua_isnil(L, -1)){
+    lua_pop(L, 1);                                         /* ... */
+    lc = (lcache_t *) lua_newuserdata(L, sizeof(lcache_t));
+    memset(lc, 0, sizeof(lcache_t));
+    lc->maxentries = LCACHE_SIZE;
+    if (luaL_newmetatable(L, "graph.lcache"))              /* ..., lc, mt */
+      register_metainfo(L, reg_lcache_metamethods);
+    lua_setmetatable(L, -2);                               /* ..., lc */
+    lua_setfield(L, LUA_REGISTRYINDEX, LCACHE_STATE);      /* ... */
+    lua_newtable(L);
+    lua_setfield(L, LUA_REGISTRYINDEX, LCACHE_ENTRIES);
+    return lc;
+  }
+  lc = (lcache_t *) lua_touserdata(L, -1);
+  lua_pop(L, 1);                                           /* ... */
+  return lc;
+}
+
+static void lcache_clear(lua_State *L, lcache_t *lc)
+{
+  lua_newtable(L);
+  lua_setfield(L, LUA_REGISTRYINDEX, LCACHE_ENTRIES);
+  lc->nentries = 0;
+}
+
+/*
+ * Graphviz layout, serialized with background layouts.
+ */
+static int layout(GVC_t *gvc, Agraph_t *g, const char *engine)
+{
+  int rv;
+
+  gv_lock();
+  rv = gvLayout(gvc, g, engine);
+  gv_unlock();
+  return rv;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Structural hash
+\*-------------------------------------------------------------------------*/
+static void h_bytes(lhash_t *hs, const void *p, size_t n)
+{
+  const unsigned char *s = (const unsigned char *) p;
+  uint64_t h = hs->h;
+
+  while (n-- > 0){
+    h ^= *s++;
+    h *= FNV_PRIME;
+  }
+  hs->h = h;
+}
+
+/* strings include the terminating NUL as separator */
+static void h_str(lhash_t *hs, const char *s)
+{
+  if (s == NULL)
+    s = "";
+  h_bytes(hs, s, strlen(s) + 1);
+}
+
+static void h_int(lhash_t *hs, uint64_t v)
+{
+  h_bytes(hs, &v, sizeof(v));
+}
+
+static int isoutattr(const char *name)
+{
+  const char **p;
+
+  for (p = outattrs; *p != NULL; p++)
+    if (!strcmp(*p, name))
+      return 1;
+  return 0;
+}
+
+static void h_attrs(lhash_t *hs, void *obj, int k)
+{
+  int i;
+  char *v;
+
+  for (i = 0; i < hs->nsyms[k]; i++){
+    v = agxget(obj, hs->syms[k][i]);
+    if (v != NULL && *v != '\0'){
+      h_str(hs, hs->syms[k][i]->name);
+      h_str(hs, v);
+    }
+  }
+  h_int(hs, UINT64_MAX);
+}
+
+static void h_graph(lhash_t *hs, Agraph_t *g)
+{
+  Agraph_t *sg;
+  Agnode_t *n;
+  Agedge_t *e;
+
+  for (sg = agfstsubg(g); sg; sg = agnxtsubg(sg)){
+    h_str(hs, agnameof(sg));
+    for (n = agfstnode(sg); n; n = agnxtnode(sg, n)){
+      h_int(hs, hs->nidx[AGSEQ(n)]);
+      for (e = agfstout(sg, n); e; e = agnxtout(sg, e))
+        h_int(hs, hs->eidx[AGSEQ(e)] | ((uint64_t) 1 << 62));
+    }
+    h_attrs(hs, sg, 0);
+    h_graph(hs, sg);
+    h_int(hs, UINT64_MAX);
+  }
+}
+
+static void lhash_free(lhash_t *hs)
+{
+  int k;
+
+  for (k = 0; k < 3; k++)
+    free(hs->syms[k]);
+  free(hs->nidx);
+  free(hs->eidx);
+}
+
+/*
+ * Compute the structural hash of graph g for the given engine: nodes,
+ * edges, subgraphs and all attribute values that are not layout output.
+ * Returns 0 on success, -1 if out of memory.
+ */
+static int lhash_compute(lhash_t *hs, Agraph_t *g, const char *engine)
+{
+  static const int kinds[3] = {AGRAPH, AGNODE, AGEDGE};
+  Agraph_t *root = agroot(g);
+  Agnode_t *n;
+  Agedge_t *e;
+  Agsym_t *sym, *pos;
+  size_t maxn = 0, maxe = 0;
+  int i, k;
+
+  memset(hs, 0, sizeof(lhash_t));
+  hs->h = FNV_OFFSET;
+  for (k = 0; k < 3; k++){
+    for (sym = agnxtattr(root, kinds[k], NULL); sym; sym = agnxtattr(root, kinds[k], sym))
+      hs->nsyms[k]++;
+    if ((hs->syms[k] = malloc(hs->nsyms[k] * sizeof(Agsym_t *) + 1)) == NULL)
+      goto fail;
+    hs->nsyms[k] = 0;
+    for (sym = agnxtattr(root, kinds[k], NULL); sym; sym = agnxtattr(root, kinds[k], sym))
+      if (!isoutattr(sym->name))
+        hs->syms[k][hs->nsyms[k]++] = sym;
+  }
+  for (n = agfstnode(g); n; n = agnxtnode(g, n)){
+    if (AGSEQ(n) > maxn)
+      maxn = AGSEQ(n);
+    for (e = agfstout(g, n); e; e = agnxtout(g, e))
+      if (AGSEQ(e) > maxe)
+        maxe = AGSEQ(e);
+  }
+  if ((hs->nidx = malloc((maxn + 1) * sizeof(int))) == NULL ||
+      (hs->eidx = malloc((maxe + 1) * sizeof(int))) == NULL)
+    goto fail;
+
+  h_str(hs, engine);
+  h_int(hs, (agisdirected(g) ? 1 : 0) | (agisstrict(g) ? 2 : 0));
+  h_attrs(hs, g, 0);
+  pos = agattr(root, AGNODE, "pos", NULL);
+  for (i = 0, n = agfstnode(g); n; n = agnxtnode(g, n)){
+    hs->nidx[AGSEQ(n)] = i++;
+    h_str(hs, agnameof(n));
+    h_attrs(hs, n, 1);
+    if (pos != NULL && *agxget(n, pos) != '\0')
+      hs->bypass = 1;
+  }
+  for (i = 0, n = agfstnode(g); n; n = agnxtnode(g, n))
+    for (e = agfstout(g, n); e; e = agnxtout(g, e)){
+      hs->eidx[AGSEQ(e)] = i++;
+      h_int(hs, hs->nidx[AGSEQ(agtail(e))]);
+      h_int(hs, hs->nidx[AGSEQ(aghead(e))]);
+      h_str(hs, agnameof(e));
+      h_attrs(hs, e, 2);
+    }
+  h_graph(hs, g);
+  return 0;
+
+fail:
+  lhash_free(hs);
+  return -1;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Cache entries
+ * An entry is a sequence of NUL terminated attribute values:
+ *   bb of the graph, bb and lp of each subgraph in depth first order,
+ *   pos of each node, pos and lp of each edge.
+\*-------------------------------------------------------------------------*/
+static void addvalue(luaL_Buffer *b, const char *s)
+{
+  luaL_addstring(b, s);
+  luaL_addchar(b, '\0');
+}
+
+static void addpoint(luaL_Buffer *b, pointf p, int last)
+{
+  char buf[64];
+
+  sprintf(buf, last ? "%.10g,%.10g" : "%.10g,%.10g ", p.x, p.y);
+  luaL_addstring(b, buf);
+}
+
+static void addbox(luaL_Buffer *b, boxf bb)
+{
+  char buf[128];
+
+  sprintf(buf, "%.10g,%.10g,%.10g,%.10g", bb.LL.x, bb.LL.y, bb.UR.x, bb.UR.y);
+  addvalue(b, buf);
+}
+
+static void addlabel(luaL_Buffer *b, textlabel_t *lab)
+{
+  if (lab != NULL && lab->set)
+    addpoint(b, lab->pos, 1);
+  luaL_addchar(b, '\0');
+}
+
+/*
+ * Edge spline in the syntax of the pos attribute.
+ */
+static void addspline(luaL_Buffer *b, splines *spl)
+{
+  bezier *bz;
+  int i, j;
+
+  for (i = 0; spl != NULL && i < spl->size; i++){
+    bz = &spl->list[i];
+    if (i > 0)
+      luaL_addchar(b, ';');
+    if (bz->sflag){
+      luaL_addstring(b, "s,");
+      addpoint(b, bz->sp, 0);
+    }
+    if (bz->eflag){
+      luaL_addstring(b, "e,");
+      addpoint(b, bz->ep, 0);
+    }
+    for (j = 0; j < bz->size; j++)
+      addpoint(b, bz->list[j], j == bz->size - 1);
+  }
+  luaL_addchar(b, '\0');
+}
+
+static void addsubgraphs(luaL_Buffer *b, Agraph_t *g)
+{
+  Agraph_t *sg;
+
+  for (sg = agfstsubg(g); sg; sg = agnxtsubg(sg)){
+    if (!strncmp(agnameof(sg), "cluster", 7) && aggetrec(sg, "Agraphinfo_t", 1)){
+      addbox(b, GD_bb(sg));
+      addlabel(b, GD_label(sg));
+    } else {
+      luaL_addchar(b, '\0');
+      luaL_addchar(b, '\0');
+    }
+    addsubgraphs(b, sg);
+  }
+}
+
+/*
+ * Serialize the layout of g from its layout records.
+ * Lua exit stack: ..., entry
+ */
+static void entry_create(lua_State *L, Agraph_t *g)
+{
+  luaL_Buffer b;
+  Agnode_t *n;
+  Agedge_t *e;
+
+  luaL_buffinit(L, &b);
+  aggetrec(g, "Agraphinfo_t", 1);
+  addbox(&b, GD_bb(g));
+  addsubgraphs(&b, g);
+  for (n = agfstnode(g); n; n = agnxtnode(g, n)){
+    aggetrec(n, "Agnodeinfo_t", 1);
+    addpoint(&b, ND_coord(n), 1);
+    luaL_addchar(&b, '\0');
+  }
+  for (n = agfstnode(g); n; n = agnxtnode(g, n))
+    for (e = agfstout(g, n); e; e = agnxtout(g, e)){
+      if (aggetrec(e, "Agedgeinfo_t", 1)){
+        addspline(&b, ED_spl(e));
+        addlabel(&b, ED_label(e));
+      } else {
+        luaL_addchar(&b, '\0');
+        luaL_addchar(&b, '\0');
+      }
+    }
+  luaL_pushresult(&b);
+}
+
+/*
+ * Temporarily set an attribute value; the old value is kept in sv.
+ * Returns -1 if the attribute is not declared.
+ */
+static int settemp(Agraph_t *root, lsaved_t *sv, int *nsv, void *obj, Agsym_t *sym,
+                   const char *val)
+{
+  if (sym == NULL)
+    return -1;
+  sv[*nsv].obj = obj;
+  sv[*nsv].sym = sym;
+  sv[*nsv].old = agstrdup(root, agxget(obj, sym));
+  (*nsv)++;
+  agxset(obj, sym, (char *) val);
+  return 0;
+}
+
+static const char *nextvalue(const char **p, const char *end)
+{
+  const char *s = *p;
+
+  if (s >= end)
+    return NULL;
+  *p += strlen(s) + 1;
+  return s;
+}
+
+static int applysubgraphs(Agraph_t *g, Agsym_t *bb, Agsym_t *lp, lsaved_t *sv, int *nsv,
+                          const char **p, const char *end)
+{
+  Agraph_t *sg;
+  const char *vbb, *vlp;
+
+  for (sg = agfstsubg(g); sg; sg = agnxtsubg(sg)){
+    if ((vbb = nextvalue(p, end)) == NULL || (vlp = nextvalue(p, end)) == NULL)
+      return -1;
+    if (*vbb && settemp(agroot(g), sv, nsv, sg, bb, vbb))
+      return -1;
+    if (*vlp && settemp(agroot(g), sv, nsv, sg, lp, vlp))
+      return -1;
+    if (applysubgraphs(sg, bb, lp, sv, nsv, p, end))
+      return -1;
+  }
+  return 0;
+}
+
+static int countsubgraphs(Agraph_t *g)
+{
+  Agraph_t *sg;
+  int n = 0;
+
+  for (sg = agfstsubg(g); sg; sg = agnxtsubg(sg))
+    n += 1 + countsubgraphs(sg);
+  return n;
+}
+
+/*
+ * Check whether the attributes needed to apply an entry to g are declared:
+ * pos of nodes and edges, lp of labelled edges, bb of clusters and lp of
+ * labelled clusters.
+ */
+static int subgraphs_usable(Agraph_t *g, int hasbb, int haslp)
+{
+  Agraph_t *sg;
+  char *label;
+
+  for (sg = agfstsubg(g); sg; sg = agnxtsubg(sg)){
+    if (!strncmp(agnameof(sg), "cluster", 7)){
+      if (!hasbb)
+        return 0;
+      if (!haslp && (label = agget(sg, "label")) != NULL && *label != '\0')
+        return 0;
+    }
+    if (!subgraphs_usable(sg, hasbb, haslp))
+      return 0;
+  }
+  return 1;
+}
+
+static int entry_usable(Agraph_t *g)
+{
+  Agraph_t *root = agroot(g);
+  Agsym_t *label;
+  Agnode_t *n;
+  Agedge_t *e;
+
+  if ((agnnodes(g) > 0 && agattr(root, AGNODE, "pos", NULL) == NULL) ||
+      (agnedges(g) > 0 && agattr(root, AGEDGE, "pos", NULL) == NULL))
+    return 0;
+  if (!subgraphs_usable(g, agattr(root, AGRAPH, "bb", NULL) != NULL,
+                        agattr(root, AGRAPH, "lp", NULL) != NULL))
+    return 0;
+  if (agattr(root, AGEDGE, "lp", NULL) == NULL &&
+      (label = agattr(root, AGEDGE, "label", NULL)) != NULL)
+    for (n = agfstnode(g); n; n = agnxtnode(g, n))
+      for (e = agfstout(g, n); e; e = agnxtout(g, e))
+        if (*agxget(e, label) != '\0')
+          return 0;
+  return 1;
+}
+
+/*
+ * Lay out g with the nop2 engine from the positions of a cache entry.
+ * Attributes set for this purpose are restored afterwards. No attribute
+ * is declared: an undeclared root bb is computed by nop2, any other
+ * undeclared attribute with a value in the entry makes the entry unusable.
+ * Returns the result of gvLayout() or -1 if the entry does not fit. A
+ * failed layout is freed.
+ */
+static int entry_apply(GVC_t *gvc, Agraph_t *g, const char *entry, size_t len)
+{
+  Agraph_t *root = agroot(g);
+  Agnode_t *n;
+  Agedge_t *e;
+  Agsym_t *gbb, *glp, *npos, *epos, *elp;
+  lsaved_t *sv;
+  const char *p = entry, *end = entry + len, *v, *vlp;
+  int i, nsv = 0, rv = -1;
+
+  sv = malloc((1 + 2 * countsubgraphs(g) + agnnodes(g) + 2 * agnedges(g)) * sizeof(lsaved_t));
+  if (sv == NULL)
+    return -1;
+  gbb = agattr(root, AGRAPH, "bb", NULL);
+  glp = agattr(root, AGRAPH, "lp", NULL);
+  npos = agattr(root, AGNODE, "pos", NULL);
+  epos = agattr(root, AGEDGE, "pos", NULL);
+  elp = agattr(root, AGEDGE, "lp", NULL);
+  if ((v = nextvalue(&p, end)) == NULL)
+    goto done;
+  if (gbb != NULL)
+    settemp(root, sv, &nsv, g, gbb, v);
+  if (applysubgraphs(g, gbb, glp, sv, &nsv, &p, end))
+    goto restore;
+  for (n = agfstnode(g); n; n = agnxtnode(g, n)){
+    if ((v = nextvalue(&p, end)) == NULL || settemp(root, sv, &nsv, n, npos, v))
+      goto restore;
+  }
+  for (n = agfstnode(g); n; n = agnxtnode(g, n))
+    for (e = agfstout(g, n); e; e = agnxtout(g, e)){
+      if ((v = nextvalue(&p, end)) == NULL || (vlp = nextvalue(&p, end)) == NULL ||
+          settemp(root, sv, &nsv, e, epos, v) ||
+          (*vlp && settemp(root, sv, &nsv, e, elp, vlp)))
+        goto restore;
+    }
+  if (p == end && (rv = layout(gvc, g, "nop2")) != 0){
+    gv_lock();
+    gvFreeLayout(gvc, g);
+    gv_unlock();
+  }
+
+restore:
+  for (i = nsv - 1; i >= 0; i--){
+    agxset(sv[i].obj, sv[i].sym, sv[i].old);
+    agstrfree(root, sv[i].old);
+  }
+done:
+  free(sv);
+  return rv;
+}
+
+/*
+ * Cache file of an entry.
+ */
+static char *entry_path(lcache_t *lc, const char *key)
+{
+  char *path = malloc(strlen(lc->dir) + strlen(key) + 6);
+
+  if (path != NULL)
+    sprintf(path, "%s/%s.lay", lc->dir, key);
+  return path;
+}
+
+/*
+ * Look up an entry in memory and in the cache directory.
+ * Lua exit stack: ..., entry or nil
+ */
+static void entry_lookup(lua_State *L, lcache_t *lc, const char *key)
+{
+  FILE *f;
+  char *path, buf[4096];
+  size_t n;
+  luaL_Buffer b;
+
+  lua_getfield(L, LUA_REGISTRYINDEX, LCACHE_ENTRIES);      /* ..., t */
+  lua_getfield(L, -1, key);                                /* ..., t, entry */
+  lua_remove(L, -2);                                       /* ..., entry */
+  if (!lua_isnil(L, -1) || lc->dir == NULL)
+    return;
+  if ((path = entry_path(lc, key)) == NULL)
+    return;
+  f = fopen(path, "rb");
+  free(path);
+  if (f == NULL)
+    return;
+  lua_pop(L, 1);                                           /* ... */
+  luaL_buffinit(L, &b);
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    luaL_addlstring(&b, buf, n);
+  fclose(f);
+  luaL_pushresult(&b);                                     /* ..., entry */
+}
+
+/*
+ * Check whether an entry is in memory.
+ */
+static int entry_known(lua_State *L, const char *key)
+{
+  int known;
+
+  lua_getfield(L, LUA_REGISTRYINDEX, LCACHE_ENTRIES);      /* ..., t */
+  lua_getfield(L, -1, key);                                /* ..., t, entry */
+  known = !lua_isnil(L, -1);
+  lua_pop(L, 2);                                           /* ... */
+  return known;
+}
+
+/*
+ * Store the entry on top of the stack in memory and in the cache directory.
+ * Replacing an entry does not count as a new one.
+ * Lua exit stack: ...
+ */
+static void entry_store(lua_State *L, lcache_t *lc, const char *key)
+{
+  FILE *f;
+  char *path;
+  size_t len;
+  const char *s = lua_tolstring(L, -1, &len);
+
+  if (lc->dir != NULL && (path = entry_path(lc, key)) != NULL){
+    if ((f = fopen(path, "wb")) != NULL){
+      fwrite(s, 1, len, f);
+      fclose(f);
+    }
+    free(path);
+  }
+  if (!entry_known(L, key)){
+    if (lc->nentries >= lc->maxentries)
+      lcache_clear(L, lc);
+    lc->nentries++;
+  }
+  lua_getfield(L, LUA_REGISTRYINDEX, LCACHE_ENTRIES);      /* ..., entry, t */
+  lua_pushvalue(L, -2);                                    /* ..., entry, t, entry */
+  lua_setfield(L, -2, key);                                /* ..., entry, t */
+  lua_pop(L, 2);                                           /* ... */
+}
+
+/*
+ * Lay out graph g with the given engine. If the layout cache is enabled,
+ * the layout of a structurally identical graph is reused.
+ * Returns the result of gvLayout().
+ */
+int lcache_layout(lua_State *L, GVC_t *gvc, Agraph_t *g, const char *engine)
+{
+  lcache_t *lc = lcache_get(L);
+  lhash_t hs;
+  char key[32];
+  size_t len;
+  const char *entry;
+  int rv;
+
+  if (!lc->enabled || !strcmp(engine, "nop") || !strcmp(engine, "nop2") ||
+      lhash_compute(&hs, g, engine))
+    return layout(gvc, g, engine);
+  lhash_free(&hs);
+  if (hs.bypass)
+    return layout(gvc, g, engine);
+  sprintf(key, "%08lx%08lx", (unsigned long)(hs.h >> 32), (unsigned long)(hs.h & 0xffffffffUL));
+  if (!entry_usable(g)){
+    /* Lay out with the engine, but still provide the entry for others */
+    lc->misses++;
+    if ((rv = layout(gvc, g, engine)) != 0 || entry_known(L, key))
+      return rv;
+    entry_create(L, g);                                    /* ..., entry */
+    entry_store(L, lc, key);                               /* ... */
+    return 0;
+  }
+  entry_lookup(L, lc, key);                                /* ..., entry or nil */
+  if (!lua_isnil(L, -1)){
+    entry = lua_tolstring(L, -1, &len);
+    rv = entry_apply(gvc, g, entry, len);
+    lua_pop(L, 1);                                         /* ... */
+    if (rv == 0){
+      lc->hits++;
+      return 0;
+    }
+  } else
+    lua_pop(L, 1);                                         /* ... */
+  lc->misses++;
+  if ((rv = layout(gvc, g, engine)) != 0)
+    return rv;
+  entry_create(L, g);                                      /* ..., entry */
+  entry_store(L, lc, key);                                 /* ... */
+  return 0;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Function: stats = graph.layoutcache([options])
+ * Configures the layout cache and retrieves its statistics. When enabled,
+ * layouts are stored under a hash of the graph structure, the engine and
+ * all attributes except layout results. Laying out an identical graph
+ * again only applies the stored positions with the nop2 engine. This
+ * requires the graph to declare 'pos' for nodes and edges, 'lp' for
+ * labelled edges and 'bb' and 'lp' for clusters; the cache never declares
+ * attributes itself and uses the engine otherwise. Graphs with node positions given in
+ * 'pos' are never cached.
+ * Options is a table with the fields:
+ *   enable: true or false
+ *   dir:    directory for persistent entries, false for memory only
+ *   size:   maximum number of entries in memory (default 256)
+ *   clear:  true drops all entries in memory and resets the statistics
+ * Returns a table with the fields enabled, hits, misses, entries and dir.
+ * Example:
+ * graph.layoutcache{enable = true, dir = "/var/cache/graphs"}
+ * g:layout("dot")
+ * print(graph.layoutcache().hits)
+\*-------------------------------------------------------------------------*/
+int gr_layoutcache(lua_State *L)
+{
+  lcache_t *lc = lcache_get(L);
+
+  if (lua_istable(L, 1)){
+    lua_getfield(L, 1, "enable");
+    if (!lua_isnil(L, -1))
+      lc->enabled = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+    lua_getfield(L, 1, "size");
+    if (!lua_isnil(L, -1))
+      lc->maxentries = (int) luaL_checknumber(L, -1);
+    lua_pop(L, 1);
+    lua_getfield(L, 1, "dir");
+    if (!lua_isnil(L, -1)){
+      free(lc->dir);
+      lc->dir = lua_isstring(L, -1) ? strdup(lua_tostring(L, -1)) : NULL;
+    }
+    lua_pop(L, 1);
+    lua_getfield(L, 1, "clear");
+    if (lua_toboolean(L, -1)){
+      lcache_clear(L, lc);
+      lc->hits = lc->misses = 0;
+    }
+    lua_pop(L, 1);
+  }
+  lua_newtable(L);
+  lua_pushboolean(L, lc->enabled);
+  lua_setfield(L, -2, "enabled");
+  lua_pushnumber(L, lc->hits);
+  lua_setfield(L, -2, "hits");
+  lua_pushnumber(L, lc->misses);
+  lua_setfield(L, -2, "misses");
+  lua_pushnumber(L, lc->nentries);
+  lua_setfield(L, -2, "entries");
+  if (lc->dir != NULL){
+    lua_pushstring(L, lc->dir);
+    lua_setfield(L, -2, "dir");
+  }
+  return 1;
+}
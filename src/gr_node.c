@@ -85,12 +85,19 @@ static const luaL_Reg reg_metamethods[] = {
  * Utility Functions
 \*-------------------------------------------------------------------------*/
 
+/*
+ * Create the node metatable.
+ */
+int init_node(lua_State *L){
+  return new_metatable(L, "node", reg_rmembers, reg_methods, reg_metamethods, 
+                       object_index_handler);
+}
+
 /*
  * Create a new Lua userdata object and configure metatable.
  */
 int new_node(lua_State *L){
-  return new_object(L, "node", reg_rmembers, reg_methods, reg_metamethods, 
-		    object_index_handler);
+  return new_object(L, "node");
 }
 
 /*-------------------------------------------------------------------------*\
@@ -279,7 +286,7 @@ int gr_graphof(lua_State *L)
     lua_pushstring(L, "no graph");
     return 2;
   }
-  return get_object(L, g);
+  return push_object(L, g);
 }
 
 /*-------------------------------------------------------------------------*\
@@ -311,7 +318,7 @@ static int gr_edge(lua_State *L)
     head = tonode(L, 2, STRICT);
   else {
     lua_pushcfunction(L, gr_create_node);             /* tail, nhead, (label), (nocreate), func */
-    get_object(L, agroot(tail->n));                   /* tail, nhead, (label), (nocreate), func, graph */
+    push_object(L, agroot(tail->n));                  /* tail, nhead, (label), (nocreate), func, graph */
     lua_pushvalue(L, 2);                              /* ... func, graph, nhead */
     if (lua_isboolean(L, 4))                                  
       lua_pushvalue(L, 4);                            /* ... func, graph, nhead, (nocreate) */
@@ -421,7 +428,6 @@ static int gr_nextedge(lua_State *L)
       ud_e->name = strdup(sbuf);
       ud_e->type = AGEDGE;
       ud_e->status = ALIVE;
-      set_object(L, e);
       return new_edge(L);
     }
   }
@@ -486,7 +492,6 @@ static int gr_nextinout(lua_State *L, edge_first_iter_t *fst, edge_next_iter_t *
       sprintf(sbuf, "edge@%lu", (unsigned long) AGID(e));
       ud_e->name = strdup(sbuf);
       ud_e->type = AGEDGE;
-      set_object(L, e);
       return new_edge(L);
     }
   }
@@ -0,0 +1,623 @@
+/*=========================================================================*\
+ * LuaGRAPH toolkit
+ * Graph support for Lua.
+ * Herbert Leuwer
+ * 30-7-2006, 01/2017
+ *
+ * Binary graph snapshots: save and load graphs without DOT parsing.
+ *
+\*=========================================================================*/
+
+/*=========================================================================*\
+ * Includes
+\*=========================================================================*/
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "gr_graph.h"
+
+/*=========================================================================*\
+ * Defines
+\*=========================================================================*/
+/*
+ * Snapshot layout - all integers are uint32 in host byte order:
+ *
+ *   header:   magic[8] version byteorder
+ *   root:     flags name
+ *   decls:    3 x (count, count x (name default))   graph, node, edge
+ *   nodes:    count, count x name
+ *   edges:    count, count x (tail head name)
+ *   values:   node values, edge values
+ *   tree:     graph(root)
+ *
+ *   values:   per object: count, count x (symbol value)
+ *   graph(g): local defaults (not for root): 3 x (count, count x (symbol value))
+ *             value list of g
+ *             count, count x (name, nodes, edges, graph(subgraph))
+ *
+ * Strings are stored as length, bytes and a terminating NUL. The length
+ * has SNAP_HTML set for HTML-like strings and is SNAP_NONAME for
+ * anonymous objects.
+ */
+#define SNAP_VERSION   (1)
+#define SNAP_BOM       (0x01020304)
+#define SNAP_HTML      (0x80000000)
+#define SNAP_NONAME    (0xffffffff)
+
+#define SNAP_DIRECTED  (1)
+#define SNAP_STRICT    (2)
+#define SNAP_NOLOOP    (4)
+
+#define NKINDS (3)
+
+/*=========================================================================*\
+ * Data
+\*=========================================================================*/
+static const char magic[8] = {'L', 'U', 'A', 'G', 'R', 'A', 'P', 'H'};
+static const int kinds[NKINDS] = {AGRAPH, AGNODE, AGEDGE};
+
+/*
+ * Save state
+ */
+struct snap_writer_s {
+  FILE *f;
+  Agraph_t *root;
+  uint32_t *nidx;          /* node index by sequence number */
+  uint32_t *eidx;          /* edge index by sequence number */
+  uint32_t *sidx[NKINDS];  /* symbol index by symbol id */
+  int nsyms[NKINDS];
+  Agsym_t *skip[NKINDS];   /* symbols whose values are not saved */
+};
+typedef struct snap_writer_s snap_writer_t;
+
+/*
+ * Load state
+ */
+struct snap_reader_s {
+  const char *p;
+  const char *end;
+  int error;
+  Agraph_t *root;
+  Agnode_t **nodes;
+  uint32_t nnodes;
+  Agedge_t **edges;
+  uint32_t nedges;
+  Agsym_t **syms[NKINDS];
+  uint32_t nsyms[NKINDS];
+};
+typedef struct snap_reader_s snap_reader_t;
+
+/*=========================================================================*\
+ * Functions
+\*=========================================================================*/
+/*-------------------------------------------------------------------------*\
+ * Save
+\*-------------------------------------------------------------------------*/
+static void put_u32(snap_writer_t *w, uint32_t v)
+{
+  fwrite(&v, sizeof(v), 1, w->f);
+}
+
+static void put_str(snap_writer_t *w, const char *s)
+{
+  uint32_t len;
+
+  if (s == NULL){
+    put_u32(w, SNAP_NONAME);
+    return;
+  }
+  len = strlen(s);
+  put_u32(w, aghtmlstr(s) ? (len | SNAP_HTML) : len);
+  fwrite(s, 1, len + 1, w->f);
+}
+
+static int kindindex(int kind)
+{
+  return (kind == AGRAPH) ? 0 : (kind == AGNODE) ? 1 : 2;
+}
+
+/*
+ * Write the attribute declarations of the root graph and number the
+ * symbols in file order.
+ */
+static int put_decls(snap_writer_t *w)
+{
+  Agsym_t *sym;
+  int i, k, maxid;
+
+  for (k = 0; k < NKINDS; k++){
+    maxid = -1;
+    w->nsyms[k] = 0;
+    for (sym = agnxtattr(w->root, kinds[k], NULL); sym; sym = agnxtattr(w->root, kinds[k], sym)){
+      w->nsyms[k]++;
+      if (sym->id > maxid)
+        maxid = sym->id;
+    }
+    if ((w->sidx[k] = malloc((maxid + 1) * sizeof(uint32_t) + 1)) == NULL)
+      return -1;
+    put_u32(w, w->nsyms[k]);
+    i = 0;
+    for (sym = agnxtattr(w->root, kinds[k], NULL); sym; sym = agnxtattr(w->root, kinds[k], sym)){
+      w->sidx[k][sym->id] = i++;
+      put_str(w, sym->name);
+      put_str(w, sym->defval);
+    }
+    w->skip[k] = agattr(w->root, kinds[k], "__attrib__", NULL);
+  }
+  return 0;
+}
+
+/*
+ * Write the attribute values of an object. Node and edge values equal
+ * to the default are omitted.
+ */
+static void put_values(snap_writer_t *w, void *obj, int alldefaults)
+{
+  Agsym_t *sym;
+  char *val;
+  uint32_t n = 0;
+  int k = kindindex(AGTYPE(obj));
+
+  for (sym = agnxtattr(w->root, kinds[k], NULL); sym; sym = agnxtattr(w->root, kinds[k], sym)){
+    val = agxget(obj, sym);
+    if (sym != w->skip[k] && (alldefaults || strcmp(val, sym->defval) != 0))
+      n++;
+  }
+  put_u32(w, n);
+  if (n == 0)
+    return;
+  for (sym = agnxtattr(w->root, kinds[k], NULL); sym; sym = agnxtattr(w->root, kinds[k], sym)){
+    val = agxget(obj, sym);
+    if (sym != w->skip[k] && (alldefaults || strcmp(val, sym->defval) != 0)){
+      put_u32(w, w->sidx[k][sym->id]);
+      put_str(w, val);
+    }
+  }
+}
+
+/*
+ * Write the attribute defaults declared locally in subgraph g.
+ */
+static void put_localdecls(snap_writer_t *w, Agraph_t *g)
+{
+  Agsym_t *sym;
+  Agraph_t *parent = agparent(g);
+  uint32_t n;
+  int k;
+
+  for (k = 0; k < NKINDS; k++){
+    n = 0;
+    for (sym = agnxtattr(g, kinds[k], NULL); sym; sym = agnxtattr(g, kinds[k], sym))
+      if (sym != agattr(parent, kinds[k], sym->name, NULL))
+        n++;
+    put_u32(w, n);
+    for (sym = agnxtattr(g, kinds[k], NULL); sym; sym = agnxtattr(g, kinds[k], sym))
+      if (sym != agattr(parent, kinds[k], sym->name, NULL)){
+        put_u32(w, w->sidx[k][sym->id]);
+        put_str(w, sym->defval);
+      }
+  }
+}
+
+/*
+ * Write a graph of the subgraph tree recursively.
+ */
+static void put_graph(snap_writer_t *w, Agraph_t *g)
+{
+  Agraph_t *sg;
+  Agnode_t *n;
+  Agedge_t *e;
+  uint32_t count;
+
+  if (g != w->root)
+    put_localdecls(w, g);
+  put_values(w, g, 1);
+  count = 0;
+  for (sg = agfstsubg(g); sg; sg = agnxtsubg(sg))
+    count++;
+  put_u32(w, count);
+  for (sg = agfstsubg(g); sg; sg = agnxtsubg(sg)){
+    put_str(w, agnameof(sg));
+    put_u32(w, agnnodes(sg));
+    for (n = agfstnode(sg); n; n = agnxtnode(sg, n))
+      put_u32(w, w->nidx[AGSEQ(n)]);
+    put_u32(w, agnedges(sg));
+    for (n = agfstnode(sg); n; n = agnxtnode(sg, n))
+      for (e = agfstout(sg, n); e; e = agnxtout(sg, e))
+        put_u32(w, w->eidx[AGSEQ(e)]);
+    put_graph(w, sg);
+  }
+}
+
+/*
+ * Save a root graph into a binary snapshot file.
+ * Returns 0 on success or -1 with an error message in err.
+ */
+int save_graph(Agraph_t *g, const char *fname, const char **err)
+{
+  snap_writer_t w;
+  Agnode_t *n;
+  Agedge_t *e;
+  uint32_t i, flags;
+  size_t maxn = 0, maxe = 0;
+  int k, rv = -1;
+
+  memset(&w, 0, sizeof(w));
+  w.root = g;
+  *err = "out of memory";
+  for (n = agfstnode(g); n; n = agnxtnode(g, n)){
+    if (AGSEQ(n) > maxn)
+      maxn = AGSEQ(n);
+    for (e = agfstout(g, n); e; e = agnxtout(g, e))
+      if (AGSEQ(e) > maxe)
+        maxe = AGSEQ(e);
+  }
+  if ((w.nidx = malloc((maxn + 1) * sizeof(uint32_t))) == NULL ||
+      (w.eidx = malloc((maxe + 1) * sizeof(uint32_t))) == NULL)
+    goto done;
+  if ((w.f = fopen(fname, "wb")) == NULL){
+    *err = "fopen failed";
+    goto done;
+  }
+  fwrite(magic, 1, sizeof(magic), w.f);
+  put_u32(&w, SNAP_VERSION);
+  put_u32(&w, SNAP_BOM);
+  flags = (agisdirected(g) ? SNAP_DIRECTED : 0) | (agisstrict(g) ? SNAP_STRICT : 0) |
+    (g->desc.no_loop ? SNAP_NOLOOP : 0);
+  put_u32(&w, flags);
+  put_str(&w, agnameof(g));
+  if (put_decls(&w))
+    goto done;
+
+  put_u32(&w, agnnodes(g));
+  for (i = 0, n = agfstnode(g); n; n = agnxtnode(g, n)){
+    w.nidx[AGSEQ(n)] = i++;
+    put_str(&w, agnameof(n));
+  }
+  put_u32(&w, agnedges(g));
+  for (i = 0, n = agfstnode(g); n; n = agnxtnode(g, n))
+    for (e = agfstout(g, n); e; e = agnxtout(g, e)){
+      w.eidx[AGSEQ(e)] = i++;
+      put_u32(&w, w.nidx[AGSEQ(agtail(e))]);
+      put_u32(&w, w.nidx[AGSEQ(aghead(e))]);
+      put_str(&w, agnameof(e));
+    }
+  for (n = agfstnode(g); n; n = agnxtnode(g, n))
+    put_values(&w, n, 0);
+  for (n = agfstnode(g); n; n = agnxtnode(g, n))
+    for (e = agfstout(g, n); e; e = agnxtout(g, e))
+      put_values(&w, e, 0);
+  put_graph(&w, g);
+
+  *err = "write failed";
+  if (!ferror(w.f))
+    rv = 0;
+done:
+  if (w.f != NULL && fclose(w.f) != 0)
+    rv = -1;
+  free(w.nidx);
+  free(w.eidx);
+  for (k = 0; k < NKINDS; k++)
+    free(w.sidx[k]);
+  return rv;
+}
+
+/*-------------------------------------------------------------------------*\
+ * Load
+\*-------------------------------------------------------------------------*/
+static uint32_t get_u32(snap_reader_t *r)
+{
+  uint32_t v;
+
+  if (r->error || r->end - r->p < (ptrdiff_t) sizeof(v)){
+    r->error = 1;
+    return 0;
+  }
+  memcpy(&v, r->p, sizeof(v));
+  r->p += sizeof(v);
+  return v;
+}
+
+/*
+ * Return a string pointing into the snapshot; html is set for HTML-like
+ * strings.
+ */
+static const char *get_str(snap_reader_t *r, int *html)
+{
+  const char *s;
+  uint32_t len = get_u32(r);
+
+  *html = 0;
+  if (r->error || len == SNAP_NONAME)
+    return NULL;
+  if (len & SNAP_HTML){
+    *html = 1;
+    len &= ~SNAP_HTML;
+  }
+  if ((size_t)(r->end - r->p) <= len || r->p[len] != '\0'){
+    r->error = 1;
+    return NULL;
+  }
+  s = r->p;
+  r->p += len + 1;
+  return s;
+}
+
+/*
+ * Read a symbol index.
+ */
+static Agsym_t *get_sym(snap_reader_t *r, int k)
+{
+  uint32_t i = get_u32(r);
+
+  if (r->error || i >= r->nsyms[k]){
+    r->error = 1;
+    return NULL;
+  }
+  return r->syms[k][i];
+}
+
+static void set_value(snap_reader_t *r, void *obj, Agsym_t *sym, const char *val, int html)
+{
+  char *hs;
+
+  if (html){
+    hs = agstrdup_html(r->root, (char *) val);
+    agxset(obj, sym, hs);
+    agstrfree(r->root, hs);
+  } else
+    agxset(obj, sym, (char *) val);
+}
+
+static void get_values(snap_reader_t *r, void *obj)
+{
+  uint32_t i, n = get_u32(r);
+  int k = kindindex(AGTYPE(obj));
+  int html;
+  Agsym_t *sym;
+  const char *val;
+
+  for (i = 0; i < n && !r->error; i++){
+    sym = get_sym(r, k);
+    val = get_str(r, &html);
+    if (!r->error && val != NULL)
+      set_value(r, obj, sym, val, html);
+  }
+}
+
+static Agsym_t *declare(snap_reader_t *r, Agraph_t *g, int kind, char *name,
+                        const char *def, int html)
+{
+  Agsym_t *sym;
+  char *hs;
+
+  if (html){
+    hs = agstrdup_html(r->root, (char *) def);
+    sym = agattr(g, kind, name, hs);
+    agstrfree(r->root, hs);
+  } else
+    sym = agattr(g, kind, name, (char *) def);
+  return sym;
+}
+
+static int get_decls(snap_reader_t *r)
+{
+  uint32_t i;
+  int k, html, dummy;
+  const char *name, *def;
+
+  for (k = 0; k < NKINDS; k++){
+    r->nsyms[k] = get_u32(r);
+    if (r->error || r->nsyms[k] > (size_t)(r->end - r->p))
+      return -1;
+    if ((r->syms[k] = malloc(r->nsyms[k] * sizeof(Agsym_t *) + 1)) == NULL)
+      return -1;
+    for (i = 0; i < r->nsyms[k]; i++){
+      name = get_str(r, &dummy);
+      def = get_str(r, &html);
+      if (r->error || name == NULL || def == NULL)
+        return -1;
+      if ((r->syms[k][i] = declare(r, r->root, kinds[k], (char *) name, def, html)) == NULL)
+        return -1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Rebuild a graph of the subgraph tree recursively.
+ */
+static int get_graph(snap_reader_t *r, Agraph_t *g)
+{
+  Agraph_t *sg;
+  Agsym_t *sym;
+  const char *name, *def;
+  uint32_t i, j, n, ix, count;
+  int k, html;
+
+  if (g != r->root){
+    for (k = 0; k < NKINDS; k++){
+      n = get_u32(r);
+      for (i = 0; i < n && !r->error; i++){
+        sym = get_sym(r, k);
+        def = get_str(r, &html);
+        if (!r->error && def != NULL)
+          declare(r, g, kinds[k], sym->name, def, html);
+      }
+    }
+  }
+  get_values(r, g);
+  count = get_u32(r);
+  for (i = 0; i < count && !r->error; i++){
+    name = get_str(r, &html);
+    if (r->error || (sg = agsubg(g, (char *) name, 1)) == NULL)
+      return -1;
+    n = get_u32(r);
+    for (j = 0; j < n && !r->error; j++){
+      ix = get_u32(r);
+      if (ix >= r->nnodes)
+        return -1;
+      agsubnode(sg, r->nodes[ix], 1);
+    }
+    n = get_u32(r);
+    for (j = 0; j < n && !r->error; j++){
+      ix = get_u32(r);
+      if (ix >= r->nedges)
+        return -1;
+      agsubedge(sg, r->edges[ix], 1);
+    }
+    if (get_graph(r, sg))
+      return -1;
+  }
+  return r->error ? -1 : 0;
+}
+
+/*
+ * Build the graph from the snapshot in memory.
+ */
+static Agraph_t *load_snapshot(snap_reader_t *r, const char **err)
+{
+  Agdesc_t desc;
+  const char *name;
+  uint32_t i, flags, tail, head;
+  int html;
+
+  *err = "invalid snapshot";
+  if (r->end - r->p < (ptrdiff_t) sizeof(magic) || memcmp(r->p, magic, sizeof(magic)))
+    return NULL;
+  r->p += sizeof(magic);
+  if (get_u32(r) != SNAP_VERSION){
+    *err = "unsupported snapshot version";
+    return NULL;
+  }
+  if (get_u32(r) != SNAP_BOM){
+    *err = "snapshot byte order mismatch";
+    return NULL;
+  }
+  flags = get_u32(r);
+  name = get_str(r, &html);
+  if (r->error || name == NULL)
+    return NULL;
+  desc = (flags & SNAP_DIRECTED) ? Agdirected : Agundirected;
+  desc.strict = (flags & SNAP_STRICT) ? 1 : 0;
+  desc.no_loop = (flags & SNAP_NOLOOP) ? 1 : 0;
+  if ((r->root = agopen((char *) name, desc, &AgDefaultDisc)) == NULL){
+    *err = "open failed";
+    return NULL;
+  }
+  if (get_decls(r))
+    goto fail;
+
+  r->nnodes = get_u32(r);
+  if (r->error || r->nnodes > (size_t)(r->end - r->p) ||
+      (r->nodes = malloc(r->nnodes * sizeof(Agnode_t *) + 1)) == NULL)
+    goto fail;
+  for (i = 0; i < r->nnodes; i++){
+    name = get_str(r, &html);
+    if (r->error || (r->nodes[i] = agnode(r->root, (char *) name, 1)) == NULL)
+      goto fail;
+  }
+  r->nedges = get_u32(r);
+  if (r->error || r->nedges > (size_t)(r->end - r->p) ||
+      (r->edges = malloc(r->nedges * sizeof(Agedge_t *) + 1)) == NULL)
+    goto fail;
+  for (i = 0; i < r->nedges; i++){
+    tail = get_u32(r);
+    head = get_u32(r);
+    name = get_str(r, &html);
+    if (r->error || tail >= r->nnodes || head >= r->nnodes)
+      goto fail;
+    if ((r->edges[i] = agedge(r->root, r->nodes[tail], r->nodes[head],
+                              (char *) name, 1)) == NULL)
+      goto fail;
+  }
+  for (i = 0; i < r->nnodes && !r->error; i++)
+    get_values(r, r->nodes[i]);
+  for (i = 0; i < r->nedges && !r->error; i++)
+    get_values(r, r->edges[i]);
+  if (r->error || get_graph(r, r->root) || r->p != r->end)
+    goto fail;
+  return r->root;
+
+fail:
+  agclose(r->root);
+  return NULL;
+}
+
+/*
+ * Load a root graph from a binary snapshot file. The file is mapped into
+ * memory where available; strings are taken directly from the mapping.
+ * Returns the graph or NULL with an error message in err.
+ */
+Agraph_t *load_graph(const char *fname, const char **err)
+{
+  snap_reader_t r;
+  Agraph_t *g = NULL;
+  char *buf = NULL;
+  size_t size = 0;
+  int k;
+#ifndef _WIN32
+  struct stat st;
+  int fd;
+
+  if ((fd = open(fname, O_RDONLY)) < 0){
+    *err = "open failed";
+    return NULL;
+  }
+  if (fstat(fd, &st) != 0 || st.st_size == 0){
+    close(fd);
+    *err = "invalid snapshot";
+    return NULL;
+  }
+  size = st.st_size;
+  buf = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (buf == MAP_FAILED){
+    *err = "mmap failed";
+    return NULL;
+  }
+#else
+  FILE *f;
+  long len;
+
+  if ((f = fopen(fname, "rb")) == NULL){
+    *err = "fopen failed";
+    return NULL;
+  }
+  if (fseek(f, 0, SEEK_END) != 0 || (len = ftell(f)) <= 0 || fseek(f, 0, SEEK_SET) != 0 ||
+      (buf = malloc(len)) == NULL || fread(buf, 1, len, f) != (size_t) len){
+    fclose(f);
+    free(buf);
+    *err = "read failed";
+    return NULL;
+  }
+  fclose(f);
+  size = len;
+#endif
+  memset(&r, 0, sizeof(r));
+  r.p = buf;
+  r.end = buf + size;
+  g = load_snapshot(&r, err);
+  free(r.nodes);
+  free(r.edges);
+  for (k = 0; k < NKINDS; k++)
+    free(r.syms[k]);
+#ifndef _WIN32
+  munmap(buf, size);
+#else
+  free(buf);
+#endif
+  return g;
+}
@@ -36,46 +36,97 @@ char *agobjkindstr(struct Agobj_s *obj)
   return kind == AGRAPH ? "graph" : kind == AGNODE ? "node" : kind == AGEDGE ? "edge" : "unknown";
 }
 
-/*
- * Insertion callback: called when an object is inserted by cgraph.
- * Used to register proxy object on top of stack in Lua registry using cgraph object as key.
- */
-void cb_insert(struct Agraph_s *g, struct Agobj_s *obj, void *L)
-{
-  /* register user data on top of stack */
-  TRACE("   cb_insert(): register object '%s' type: %s\n", agnameof(obj), agobjkindstr(obj));
-  set_object((lua_State *)L, (void *) obj);
-}
-
 /*
  * Deletion callback: called when an object is inserted by cgraph.
  * De-register proxy object.
  */
 void cb_delete(Agraph_t *g, Agobj_t *obj, void *L)
 {
-  char *skey;
-
   TRACE("   cb_delete() : unregister object '%s' kind=%s ptr=%p\n", agnameof(obj),
         agobjkind(obj) == AGRAPH ? "graph" : agobjkind(obj) == AGNODE ? "node" :
         agobjkind(obj) == AGEDGE ? "edge" : "unknown", obj);
-  skey = agget(obj, "__attrib__");
-  if (skey && (strlen(skey) != 0)) {
-    printf("   cb_delete(): nulling attrib\n");
-    lua_pushstring(L, skey);
-    lua_pushnil(L);
-    lua_rawset(L, LUA_REGISTRYINDEX);
-    agset(obj, "__attrib__", NULL);
-    agstrfree(agroot(obj), skey);
-  }
+  del_fields(L, obj);
   del_object(L, obj);
+  if (AGTYPE(obj) == AGRAPH && agroot(obj) == (Agraph_t *) obj){
+    del_cache(L, obj);
+    del_numattrs((Agraph_t *) obj);
+  }
+}
+
+/*
+ * Lua fields of graph objects: one table per object in a side table of
+ * the registry, keyed by root graph and cgraph object. Edges use their
+ * out-edge half, so that both halves share the fields.
+ */
+static char fieldskey;
+
+static void *fieldobj(void *obj)
+{
+  return (AGTYPE(obj) == AGINEDGE) ? (void *) agopp((Agedge_t *) obj) : obj;
+}
+
+/*
+ * Push the value of key in table t or a new table stored under key, if
+ * the value is nil and create is true.
+ * Lua exit stack: ?, value or nil
+ */
+static void push_subtable(lua_State *L, int t, void *key, int create)
+{
+  t = lua_absindex(L, t);
+  lua_pushlightuserdata(L, key);           /* ?, key */
+  lua_rawget(L, t);                        /* ?, value or nil */
+  if (lua_isnil(L, -1) && create){
+    lua_pop(L, 1);                         /* ? */
+    lua_newtable(L);                       /* ?, value */
+    lua_pushlightuserdata(L, key);         /* ?, value, key */
+    lua_pushvalue(L, -2);                  /* ?, value, key, value */
+    lua_rawset(L, t);                      /* ?, value */
+  }
+}
+
+/*
+ * Push the field table of obj or nil. If create is true, a missing table
+ * is created.
+ * Lua exit stack: ?, ftab or nil
+ */
+static void push_fields(lua_State *L, void *obj, int create)
+{
+  push_subtable(L, LUA_REGISTRYINDEX, &fieldskey, create); /* ?, fields or nil */
+  if (lua_isnil(L, -1))
+    return;
+  push_subtable(L, -1, agroot(obj), create);  /* ?, fields, rfields or nil */
+  lua_remove(L, -2);                          /* ?, rfields or nil */
+  if (lua_isnil(L, -1))
+    return;
+  push_subtable(L, -1, fieldobj(obj), create); /* ?, rfields, ftab or nil */
+  lua_remove(L, -2);                          /* ?, ftab or nil */
 }
 
 /*
- * Modification callback. Not used by LuaGRAPH
- */ 
-void cb_modify(Agraph_t *g, Agobj_t *obj, void *L, Agsym_t *sym)
+ * Drop the Lua fields of a deleted object. For a root graph the fields of
+ * all its objects are dropped at once.
+ */
+void del_fields(lua_State *L, void *obj)
 {
-  TRACE("   cb_modify(): modify object '%s'\n", agnameof(obj));
+  void *root = agroot(obj);
+
+  push_subtable(L, LUA_REGISTRYINDEX, &fieldskey, 0); /* ?, fields or nil */
+  if (!lua_isnil(L, -1)){
+    if (obj == root){
+      lua_pushlightuserdata(L, root);
+      lua_pushnil(L);                      /* ?, fields, root, nil */
+      lua_rawset(L, -3);                   /* ?, fields */
+    } else {
+      push_subtable(L, -1, root, 0);       /* ?, fields, rfields or nil */
+      if (!lua_isnil(L, -1)){
+        lua_pushlightuserdata(L, fieldobj(obj));
+        lua_pushnil(L);                    /* ?, fields, rfields, obj, nil */
+        lua_rawset(L, -3);                 /* ?, fields, rfields */
+      }
+      lua_pop(L, 1);                       /* ?, fields */
+    }
+  }
+  lua_pop(L, 1);                           /* ? */
 }
 
 /*
@@ -101,18 +152,77 @@ gr_object_t *toobject(lua_State *L, int narg, const char *type, int strict)
     lua_error(L);
     return NULL;
   }
+  if (strict && async_busy(ud->p.p)){
+    luaL_error(L, "bad argument #%d (graph busy: layout running in background)", narg);
+    return NULL;
+  }
   return ud;
 }
 
 /*
- * Register an object in Lua registry.
+ * Proxies live in a weak valued cache table per root graph, registered
+ * in the Lua registry with the root graph as key. Proxies no longer
+ * referenced by Lua are collected and recreated on demand.
+ * Pushes the cache of the root graph of key - or nil if the cache does
+ * not exist and create is false.
+ * Lua exit stack: ?, cache or nil
+ */
+static int push_cache(lua_State *L, void *key, int create)
+{
+  void *root = agroot(key);
+
+  lua_pushlightuserdata(L, root);      /* ?, root */
+  lua_rawget(L, LUA_REGISTRYINDEX);    /* ?, cache or nil */
+  if (!lua_isnil(L, -1) || !create)
+    return 1;
+  lua_pop(L, 1);                       /* ? */
+  lua_newtable(L);                     /* ?, cache */
+  if (luaL_newmetatable(L, "graph.proxies")){  /* ?, cache, mt */
+    lua_pushliteral(L, "v");
+    lua_setfield(L, -2, "__mode");
+  }
+  lua_setmetatable(L, -2);             /* ?, cache */
+  lua_pushlightuserdata(L, root);      /* ?, cache, root */
+  lua_pushvalue(L, -2);                /* ?, cache, root, cache */
+  lua_rawset(L, LUA_REGISTRYINDEX);    /* ?, cache */
+  return 1;
+}
+
+/*
+ * Drop the proxy cache of a closed root graph. All proxies still in the
+ * cache are marked dead in one sweep.
+ */
+void del_cache(lua_State *L, void *root)
+{
+  gr_object_t *ud;
+
+  push_cache(L, root, 0);              /* ?, cache or nil */
+  if (!lua_isnil(L, -1)){
+    lua_pushnil(L);                    /* ?, cache, nil */
+    while (lua_next(L, -2)){           /* ?, cache, key, ud */
+      if ((ud = lua_touserdata(L, -1)) != NULL)
+        ud->p.status = DEAD;
+      lua_pop(L, 1);                   /* ?, cache, key */
+    }
+  }
+  lua_pop(L, 1);                       /* ? */
+  lua_pushlightuserdata(L, root);
+  lua_pushnil(L);
+  lua_rawset(L, LUA_REGISTRYINDEX);
+}
+
+/*
+ * Register the object on top of the stack in the proxy cache; the cache
+ * is created with the first proxy of a root graph.
  */
 int set_object(lua_State *L, void *key)
 {
   TRACE("   set_object(): key=%p (%s %d)\n", key, __FILE__, __LINE__);
-  lua_pushlightuserdata(L, key);       /* ud, key */
-  lua_pushvalue(L, -2);                /* ud, key, ud */
-  lua_rawset(L, LUA_REGISTRYINDEX);    /* ud */
+  push_cache(L, key, 1);               /* ud, cache */
+  lua_pushlightuserdata(L, key);       /* ud, cache, key */
+  lua_pushvalue(L, -3);                /* ud, cache, key, ud */
+  lua_rawset(L, -3);                   /* ud, cache */
+  lua_pop(L, 1);                       /* ud */
   return 1;
 }
 
@@ -120,23 +230,33 @@ int set_status(lua_State *L, void *key, int status)
 {
   gr_object_t *ud;
   
-  lua_pushlightuserdata(L, key);       /* ?, key */
-  lua_rawget(L, LUA_REGISTRYINDEX);
+  push_cache(L, key, 0);               /* ?, cache or nil */
+  if (lua_isnil(L, -1)){
+    lua_pop(L, 1);
+    return 0;
+  }
+  lua_pushlightuserdata(L, key);       /* ?, cache, key */
+  lua_rawget(L, -2);                   /* ?, cache, ud */
   ud = lua_touserdata(L, -1);
   if (ud)
     ud->p.status = status;
+  lua_pop(L, 2);                       /* ? */
   return 0;
 }
 /*
- * Delete an object from Lua registry.
+ * Delete an object from the proxy cache.
  */
 int del_object(lua_State *L, void *key)
 {
   TRACE("   del_object(): key=%p '%s' (%s %d)\n", key, agnameof(key), __FILE__, __LINE__);
   set_status(L, key, DEAD);
-  lua_pushlightuserdata(L, key);
-  lua_pushnil(L);                      /* ?, key, nil */
-  lua_rawset(L, LUA_REGISTRYINDEX);    /* ? */
+  push_cache(L, key, 0);               /* ?, cache or nil */
+  if (!lua_isnil(L, -1)){
+    lua_pushlightuserdata(L, key);
+    lua_pushnil(L);                    /* ?, cache, key, nil */
+    lua_rawset(L, -3);                 /* ?, cache */
+  }
+  lua_pop(L, 1);                       /* ? */
   return 0;
 }
 
@@ -178,9 +298,21 @@ int gr_collect(lua_State *L)
 int get_object(lua_State *L, void *key)
 {
   gr_object_t *ud;
-  lua_pushlightuserdata(L, key);               /* ?, key */
-  lua_rawget(L, LUA_REGISTRYINDEX);            /* ?, ud or nil */
+  push_cache(L, key, 0);                       /* ?, cache or nil */
+  if (lua_isnil(L, -1)){
+    lua_pushstring(L, "object not found in registry");            /* ?, nil, err */
+    return 2;
+  }
+  lua_pushlightuserdata(L, key);               /* ?, cache, key */
+  lua_rawget(L, -2);                           /* ?, cache, ud or nil */
+  lua_remove(L, -2);                           /* ?, ud or nil */
   ud = lua_touserdata(L, -1);
+  if (ud != NULL && ud->p.p == NULL){
+    /* proxy collected but not yet cleared from the cache */
+    lua_pop(L, 1);
+    lua_pushnil(L);
+    ud = NULL;
+  }
   if (ud == NULL){                          
     TRACE("   get_object(): key = %p not found (%s %d)\n", key, __FILE__, __LINE__);
     lua_pushstring(L, "object not found in registry");            /* ?, nil, err */
@@ -190,6 +322,56 @@ int get_object(lua_State *L, void *key)
   return 1;                                    /* ?, ud */
 }
 
+/*
+ * Get an object from Lua registry. If no proxy is registered for the object
+ * yet, e.g. because the object was created without Lua involvement, the proxy
+ * is created and registered on the fly.
+ * Lua exit stack: ?, ud
+ */
+int push_object(lua_State *L, void *key)
+{
+  gr_object_t *ud;
+  char sbuf[32];
+  char *name;
+  const char *kind;
+  
+  if (get_object(L, key) == 1)
+    return 1;
+  lua_pop(L, 2);                               /* ? */
+  switch (AGTYPE(key)){
+  case AGRAPH:
+    kind = "graph";
+    ud = lua_newuserdata(L, sizeof(gr_graph_t));
+    ud->g.lastedge = NULL;
+    name = agnameof(key);
+    break;
+  case AGNODE:
+    kind = "node";
+    ud = lua_newuserdata(L, sizeof(gr_node_t));
+    name = agnameof(key);
+    break;
+  default:
+    /* An edge might be registered with its opposite half */
+    if (get_object(L, agopp((Agedge_t *) key)) == 1)
+      return 1;
+    lua_pop(L, 2);                             /* ? */
+    kind = "edge";
+    ud = lua_newuserdata(L, sizeof(gr_edge_t));
+    name = agnameof(key);
+    if (name == NULL){
+      sprintf(sbuf, "edge@%lu", (unsigned long) AGID(key));
+      name = sbuf;
+    }
+    break;
+  }                                            /* ?, ud */
+  ud->p.p = key;
+  ud->p.name = strdup(name);
+  ud->p.type = (AGTYPE(key) == AGINEDGE) ? AGEDGE : AGTYPE(key);
+  ud->p.status = ALIVE;
+  TRACE("   push_object(): key=%p ud=%p '%s' created (%s %d)\n", key, ud, ud->p.name, __FILE__, __LINE__);
+  return new_object(L, kind);                  /* ?, ud */
+}
+
 /*
  * Get the value of a graphviz object attribute
  */
@@ -197,7 +379,11 @@ int getval(lua_State *L)
 {
   gr_object_t *ud = toobject(L, 1, NULL, STRICT);
   char *key = (char *) luaL_checkstring(L, 2);
-  char *value = agget(ud->p.p, key);
+  char *value;
+
+  if (numattr_index(L, ud->p.p, key))
+    return 1;
+  value = agget(ud->p.p, key);
   if (!value || strlen(value) == 0){
     lua_pushnil(L);
     return 1;
@@ -228,7 +414,6 @@ static int setval(lua_State *L)
 int object_index_handler(lua_State *L)
 {
   gr_object_t *ud;
-  char *skey;
 
   /* Read member lookup in first upvalue */
   lua_pushvalue(L, 2);                      /* ud, key, key */
@@ -251,15 +436,12 @@ int object_index_handler(lua_State *L)
 	/* Try generic storage */
 	lua_settop(L, 2);                      /* ud, key */
 	ud = toobject(L, 1, NULL, STRICT);
-	skey = agget(ud->p.p, "__attrib__");
-	if (skey && strlen(skey) > 0){
-	  lua_pushstring(L, skey);            /* ud, key, skey */
-	  lua_rawget(L, LUA_REGISTRYINDEX);   /* ud, key, stab */
-	  lua_pushvalue(L, 2);                /* ud, key, stab, key */
-	  lua_rawget(L, -2);                  /* ud, key, stab, value */
+	push_fields(L, ud->p.p, 0);            /* ud, key, ftab or nil */
+	if (!lua_isnil(L, -1)){
+	  lua_pushvalue(L, 2);                /* ud, key, ftab, key */
+	  lua_rawget(L, -2);                  /* ud, key, ftab, value */
 	  lua_remove(L, -2);                  /* ud, key, value */
-	} else
-	  lua_pushnil(L);                     /* ud, key, nil */
+	}
       }
     }
     return 1;
@@ -277,76 +459,84 @@ int object_index_handler(lua_State *L)
  */
 int object_newindex_handler(lua_State *L)
 {
-  char sskey[16], *skey;
   TRACE("   newindex(): key='%s' value='%s'\n", lua_tostring(L, 2), lua_tostring(L, 3));
+  if (numattr_newindex(L))
+    return 0;
   if ((!lua_isstring(L, 2)) || (!lua_isstring(L, 3))){
     gr_object_t *ud = toobject(L, 1, NULL, STRICT);
-    skey = agget(ud->p.p, "__attrib__");
-    if (!skey || (strlen(skey) == 0)){
-      /* Let's create an attrib table on the fly if none exists */
-      sprintf(sskey, "%p", ud->p.p);
-      skey = agstrdup(agroot(ud->p.p), sskey);
-      agset(ud->p.p, "__attrib__", skey);
-      lua_pushstring(L, skey);             /* ud, key, value, skey */
-      lua_newtable(L);                     /* ud, key, value, skey, stab */
-      lua_rawset(L, LUA_REGISTRYINDEX);    /* ud, key, value, */
-    }
-    lua_pushstring(L, skey);          /* ud, key, value, skey */
-    lua_rawget(L, LUA_REGISTRYINDEX); /* ud, key, value, stab */
-    lua_pushvalue(L, 2);              /* ud, key, value, stab, key */
-    lua_pushvalue(L, 3);              /* ud, key, value, stab, key, value */
-    lua_rawset(L, -3);                /* ud, key, value, stab */
-    lua_pop(L, -1);                   /* ud, key, value */
+    /* The field table is created on the fly if none exists */
+    push_fields(L, ud->p.p, !lua_isnil(L, 3)); /* ud, key, value, ftab or nil */
+    if (lua_isnil(L, -1))
+      return 0;
+    lua_pushvalue(L, 2);              /* ud, key, value, ftab, key */
+    lua_pushvalue(L, 3);              /* ud, key, value, ftab, key, value */
+    lua_rawset(L, -3);                /* ud, key, value, ftab */
+    lua_pop(L, 1);                    /* ud, key, value */
     return 0;
   }
   return setval(L);
 }
 
 /*
- * Create the graph object with member and method access.
- * Lua entry stack: ud
- * Lua exit stack:  ud
+ * Create the metatable for the given kind of graph objects with member and
+ * method access. Called once per kind at module initialization; proxies only
+ * attach the prepared metatable (see new_object()).
+ * Lua entry stack: -
+ * Lua exit stack:  -
  */
-int new_object(lua_State *L, const char *kind, const luaL_Reg *reg_rmembers, 
-	       const luaL_Reg *reg_methods, const luaL_Reg *reg_metamethods,
-	       index_handler_t *index_handler)
+int new_metatable(lua_State *L, const char *kind, const luaL_Reg *reg_rmembers, 
+                  const luaL_Reg *reg_methods, const luaL_Reg *reg_metamethods,
+                  index_handler_t *index_handler)
 {
   int methods, metatable;
   /* Put methods in a table */
-  lua_newtable(L);                         /* ud, mtab */
+  lua_newtable(L);                         /* mtab */
 
   register_metainfo(L, reg_methods);
   methods = lua_gettop(L);
 
   /* Put metamethods in a new metatable */
-  luaL_newmetatable(L, kind);             /* ud, mtab, mt */
+  luaL_newmetatable(L, kind);              /* mtab, mt */
 
   register_metainfo(L, reg_metamethods);
   metatable = lua_gettop(L);
 
   /* Keep a reference to methods in the new metatable */
-  lua_pushstring(L, "__metatable");        /* ud, mtab, mt, "__metatable" */
-  lua_pushvalue(L, methods);               /* ud, mtab, mt, "__metatable", mtab */
-  lua_rawset(L, -3);                       /* ud, mtab, mt */
+  lua_pushstring(L, "__metatable");        /* mtab, mt, "__metatable" */
+  lua_pushvalue(L, methods);               /* mtab, mt, "__metatable", mtab */
+  lua_rawset(L, -3);                       /* mtab, mt */
 
-  lua_pushstring(L, "__index");            /* ud, mtab, mt, "__index" */
+  lua_pushstring(L, "__index");            /* mtab, mt, "__index" */
 
   /* First upvalue: metatable => members access */
-  lua_pushvalue(L, metatable);             /* ud, mtab, mt, "__index", mt(upv 1) */
+  lua_pushvalue(L, metatable);             /* mtab, mt, "__index", mt(upv 1) */
 
   /* Put members into the metatable */
   register_metainfo(L, reg_rmembers);     
 
   /* Second upvalue, methods => methods access */
-  lua_pushvalue(L, methods);              /* ud, mtab, mt, "__index", mt(upv 1), mtab(upv 2) */
+  lua_pushvalue(L, methods);               /* mtab, mt, "__index", mt(upv 1), mtab(upv 2) */
 
   /* Set index_handler with 2 upvalues as __index metamethod */
-  lua_pushcclosure(L, index_handler, 2);  /* ud, mtab, mt, "__index", func */
-  lua_rawset(L, metatable);               /* ud, mtab, mt */
+  lua_pushcclosure(L, index_handler, 2);   /* mtab, mt, "__index", func */
+  lua_rawset(L, metatable);                /* mtab, mt */
 
-  lua_setmetatable(L, -3);           /* ud, mtab */
-  lua_pop(L,1);                           /* ud */
+  lua_pop(L, 2);                           /* - */
+  return 0;
+}
 
+/*
+ * Attach the metatable of the given kind to a new proxy and register it
+ * in the proxy cache. Objects created without proxy are not registered:
+ * their proxies are created on demand by push_object().
+ * Lua entry stack: ud
+ * Lua exit stack:  ud
+ */
+int new_object(lua_State *L, const char *kind)
+{
+  luaL_getmetatable(L, kind);              /* ud, mt */
+  lua_setmetatable(L, -2);                 /* ud */
+  set_object(L, ((gr_object_t *) lua_touserdata(L, -1))->p.p);
   return 1;
 }
 
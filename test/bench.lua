@@ -0,0 +1,284 @@
+local graph = require "graph"
+
+----------------------------------------------------------------------
+-- Simple throughput benchmarks.
+-- Usage: lua test/bench.lua [N]
+----------------------------------------------------------------------
+local N = tonumber(arg[1]) or 100000
+
+local function report(what, count, t)
+   if t <= 0 then t = 1e-9 end
+   print(string.format("%-28s %9d in %7.3f s  %12.0f/s", what, count, t, count / t))
+   io.stdout:flush()
+end
+
+local function retained(what, count, kb0)
+   collectgarbage("collect")
+   print(string.format("%-28s %9d  %12.0f kB retained", what, count, collectgarbage("count") - kb0))
+   io.stdout:flush()
+end
+
+local function measure(what, count, func)
+   collectgarbage("collect")
+   local t0 = os.clock()
+   func()
+   report(what, count, os.clock() - t0)
+end
+
+-- Wall clock time: os.clock() misses the time of worker threads and processes.
+-- Uses LuaSocket if available, whole seconds otherwise.
+local has_socket, socket = pcall(require, "socket")
+local wallclock = has_socket and socket.gettime or os.time
+
+local function measure_wall(what, count, func)
+   collectgarbage("collect")
+   local t0 = wallclock()
+   func()
+   report(what, count, wallclock() - t0)
+end
+
+----------------------------------------------------------------------
+-- Benchmarks
+----------------------------------------------------------------------
+local function bench_create()
+   local g = graph.open("G")
+   local nodes = {}
+   measure("node creation", N, function()
+      for i = 1, N do
+         nodes[i] = g:node("N"..i)
+      end
+   end)
+   measure("edge creation", N - 1, function()
+      for i = 1, N - 1 do
+         g:edge(nodes[i], nodes[i+1])
+      end
+   end)
+   measure("close", 2 * N - 1, function()
+      g:close()
+   end)
+end
+
+local function bench_addedges()
+   local g = graph.open("G")
+   local tails, heads = {}, {}
+   for i = 1, N - 1 do
+      tails[i], heads[i] = "N"..i, "N"..(i + 1)
+   end
+   measure("bulk edge import", N - 1, function()
+      g:addedges(tails, heads)
+   end)
+   g:close()
+end
+
+local function bench_iterate()
+   local g = graph.open("G")
+   local tails, heads = {}, {}
+   for i = 1, N - 1 do
+      tails[i], heads[i] = "N"..i, "N"..(i + 1)
+   end
+   g:addedges(tails, heads)
+   measure("walknodeids", N, function()
+      for id, name in g:walknodeids() do end
+   end)
+   measure("nodenames", N, function()
+      g:nodenames()
+   end)
+   measure("walknodes", N, function()
+      for n in g:walknodes() do end
+   end)
+   g:close()
+end
+
+local function bench_shortestpaths()
+   local g = graph.open("G", "directed")
+   local tails, heads, weights = {}, {}, {}
+   for i = 1, N - 1 do
+      tails[i], heads[i], weights[i] = "N"..i, "N"..(i + 1), tostring(i % 7 + 1)
+   end
+   g:addedges(tails, heads, {weight = weights})
+   measure("shortestpaths", N, function()
+      g:shortestpaths("N1", "weight")
+   end)
+   g:close()
+end
+
+local function bench_pagerank()
+   local g = graph.open("G", "directed")
+   local tails, heads = {}, {}
+   for i = 1, N do
+      tails[2*i-1], heads[2*i-1] = "N"..i, "N"..(i % N + 1)
+      tails[2*i], heads[2*i] = "N"..i, "N"..((i * 7) % N + 1)
+   end
+   g:addedges(tails, heads)
+   for _, threads in ipairs{1, 4} do
+      measure_wall("pagerank threads="..threads, 2 * N, function()
+         g:pagerank{threads = threads, tol = 0, maxiter = 20}
+      end)
+   end
+   g:close()
+end
+
+local function bench_snapshot()
+   local g = graph.open("G")
+   local tails, heads, labels = {}, {}, {}
+   for i = 1, N - 1 do
+      tails[i], heads[i], labels[i] = "N"..i, "N"..(i + 1), "e"..i
+   end
+   g:addedges(tails, heads, {label = labels})
+   local fdot, fsnap = os.tmpname(), os.tmpname()
+   g:write(fdot)
+   g:save(fsnap)
+   g:close()
+   measure("read DOT", N - 1, function()
+      graph.read(fdot):close()
+   end)
+   measure("load snapshot", N - 1, function()
+      graph.load(fsnap):close()
+   end)
+   os.remove(fdot)
+   os.remove(fsnap)
+end
+
+local function bench_layoutcache()
+   local M, R = math.min(N, 500), 10
+   local g = graph.open("G", "directed")
+   local tails, heads = {}, {}
+   for i = 1, M - 1 do
+      tails[2*i-1], heads[2*i-1] = "N"..i, "N"..(i + 1)
+      tails[2*i], heads[2*i] = "N"..i, "N"..((i * 7) % M + 1)
+   end
+   g:addedges(tails, heads)
+   local function run()
+      for i = 1, R do
+         g:layout("dot")
+         g:freelayout()
+      end
+   end
+   measure("layout dot", R, run)
+   graph.layoutcache{enable = true, clear = true}
+   measure("layout dot cached", R, run)
+   graph.layoutcache{enable = false, clear = true}
+   g:close()
+end
+
+local function bench_batchrender()
+   local M = math.max(1, math.floor(N / 2000))
+   local inputs = {}
+   for k = 1, 16 do
+      local g = graph.open("G"..k, "directed")
+      local tails, heads = {}, {}
+      for i = 1, 50 * M do
+         tails[i], heads[i] = "N"..i, "N"..((i * k) % (50 * M) + 1)
+      end
+      g:addedges(tails, heads)
+      inputs[k] = os.tmpname()
+      g:write(inputs[k])
+      g:close()
+   end
+   for _, threads in ipairs{1, 4} do
+      measure_wall("batchrender threads="..threads, #inputs, function()
+         graph.batchrender{inputs = inputs, formats = {"svg", "plain"}, threads = threads}
+      end)
+   end
+   for _, fn in ipairs(inputs) do
+      os.remove(fn)
+      os.remove(fn..".svg")
+      os.remove(fn..".plain")
+   end
+end
+
+local function bench_proxymem()
+   local g = graph.open("G")
+   collectgarbage("collect")
+   local kb0 = collectgarbage("count")
+   measure("node proxies", N, function()
+      for i = 1, N do g:node("N"..i) end
+   end)
+   retained("node proxies", N, kb0)
+   measure("walknodes", N, function()
+      for n in g:walknodes() do end
+   end)
+   retained("walknodes", N, kb0)
+   g:close()
+end
+
+local function bench_attrsym()
+   local g = graph.open("G")
+   local tails, heads = {}, {}
+   for i = 1, N - 1 do
+      tails[i], heads[i] = "N"..i, "N"..(i + 1)
+   end
+   g:addedges(tails, heads)
+   local nodes = g:nodes()
+   measure("n.color = x", N, function()
+      for i = 1, #nodes do nodes[i].color = "red" end
+   end)
+   local h = g:attrsym("node", "color", "")
+   measure("h:set(n, x)", N, function()
+      for i = 1, #nodes do h:set(nodes[i], "blue") end
+   end)
+   measure("n.color", N, function()
+      for i = 1, #nodes do local v = nodes[i].color end
+   end)
+   measure("h:get(n)", N, function()
+      for i = 1, #nodes do local v = h:get(nodes[i]) end
+   end)
+   local colors = {}
+   for i = 1, #nodes do colors[i] = "green" end
+   measure("g:setcolumn()", N, function()
+      g:setcolumn("node", "color", colors)
+   end)
+   measure("g:getcolumn()", N, function()
+      local v = g:getcolumn("node", "color")
+   end)
+   g:close()
+end
+
+local function bench_numeric()
+   local g = graph.open("G")
+   local tails, heads = {}, {}
+   for i = 1, N - 1 do
+      tails[i], heads[i] = "N"..i, "N"..(i + 1)
+   end
+   g:addedges(tails, heads)
+   local nodes = g:nodes()
+   measure("n.score = i (string)", N, function()
+      for i = 1, #nodes do nodes[i].score = i end
+   end)
+   measure("sum n.score (string)", N, function()
+      local sum = 0
+      for i = 1, #nodes do sum = sum + nodes[i].score end
+   end)
+   g:close()
+   g = graph.open("G")
+   g:addedges(tails, heads)
+   nodes = g:nodes()
+   g:declare_numeric("node", "score")
+   measure("n.score = i (numeric)", N, function()
+      for i = 1, #nodes do nodes[i].score = i end
+   end)
+   measure("sum n.score (numeric)", N, function()
+      local sum = 0
+      for i = 1, #nodes do sum = sum + nodes[i].score end
+   end)
+   g:close()
+end
+
+local benchmarks = {
+   bench_create,
+   bench_addedges,
+   bench_iterate,
+   bench_proxymem,
+   bench_attrsym,
+   bench_numeric,
+   bench_shortestpaths,
+   bench_pagerank,
+   bench_snapshot,
+   bench_layoutcache,
+   bench_batchrender,
+}
+
+print(string.format("LuaGRAPH %s benchmarks, N=%d", graph._VERSION, N))
+for _, f in ipairs(benchmarks) do
+   f()
+end
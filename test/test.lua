@@ -154,9 +154,133 @@ local function test_graph_write()
   local s = assert(f:read("*a"))
   log:debug("out: %s ", s)
   log:info("!!! ATTENTION: Todo: compare dot files")
+  -- Write to string and sink
+  assert(h:writestring() == s)
+  local chunks = {}
+  assert(h:write(function(chunk) table.insert(chunks, chunk) end))
+  assert(table.concat(chunks) == s)
+  local ok, err = pcall(h.write, h, function(chunk) error("sink failed") end)
+  assert(ok == false and string.find(err, "sink failed"))
+  -- Writing graphs from within the sink of a graph larger than one chunk
+  local big = graph.open("big", "directed")
+  local tails, heads = {}, {}
+  for i = 1, 5000 do
+    tails[i], heads[i] = "node"..i, "node"..(i + 1)
+  end
+  big:addedges(tails, heads)
+  local bigs = big:writestring()
+  assert(#bigs > 64 * 1024)
+  local fn2 = tmpname()
+  chunks = {}
+  assert(big:write(function(chunk)
+    table.insert(chunks, chunk)
+    assert(h:writestring() == s and big:write(fn2) == 0)
+  end))
+  debug("  %d chunks of %d bytes", #chunks, #bigs)
+  assert(#chunks > 1 and table.concat(chunks) == bigs)
+  local f2 = assert(io.open(fn2))
+  assert(f2:read("*a") == bigs)
+  f2:close()
+  os.remove(fn2)
+  big:close()
   fref:close()
   f:close()
+  os.remove(fn)
+  h:close()
+  intro("passed")
+end
+
+local function test_graph_readall()
+  intro("Test graph: readall ...")
+  local fn = tmpname()
+  local f = assert(io.open(fn, "w"))
+  for i = 1, 3 do
+    f:write(string.format("digraph G%d { a%d -> b%d; b%d -> c%d }\n", i, i, i, i, i))
+  end
+  f:close()
+  local n = 0
+  for g in graph.readall(fn) do
+    n = n + 1
+    debug("  read graph %q", g.name)
+    assert(g.name == "G"..n)
+    assert(g.nnodes == 3 and g.nedges == 2)
+    assert(g:findnode("b"..n))
+    g:close()
+  end
+  assert(n == 3)
+  debug("  syntax error in the second graph")
+  f = assert(io.open(fn, "w"))
+  f:write("digraph G1 { a -> b }\ndigraph G2 { a -> }\ndigraph G3 { c }\n")
+  f:close()
+  local iter = graph.readall(fn)
+  local g = assert(iter())
+  assert(g.name == "G1")
+  g:close()
+  local ok, msg = pcall(iter)
+  debug("  %s", tostring(msg))
+  assert(ok == false and string.find(msg, "agread failed after 1 graphs", 1, true))
+  assert(iter() == nil)
+  local iter, err = graph.readall("nonexistent.dot")
+  assert(iter == nil and err)
+  os.remove(fn)
+  intro("passed")
+end
+
+local function test_graph_readstream()
+  intro("Test graph: read from handle and reader function ...")
+  local ref = assert(graph.read("test/test_dat1.dot"))
+  local s = ref:writestring()
+  ref:close()
+  -- Lua io handle
+  local f = assert(io.open("test/test_dat1.dot"))
+  local g = assert(graph.read(f))
+  f:close()
+  assert(g:writestring() == s)
+  g:close()
+  -- Reader function with small chunks
+  f = assert(io.open("test/test_dat1.dot"))
+  local text = f:read("*a")
+  f:close()
+  local pos = 1
+  g = assert(graph.read(function()
+    local chunk = string.sub(text, pos, pos + 6)
+    pos = pos + 7
+    if #chunk > 0 then return chunk end
+  end))
+  assert(g:writestring() == s)
+  g:close()
+  -- Reader errors are propagated
+  local ok, err = pcall(graph.read, function() error("reader failed") end)
+  assert(ok == false and string.find(err, "reader failed"))
+  intro("passed")
+end
+
+local function test_graph_snapshot()
+  intro("Test graph: save and load snapshot ...")
+  local fn = tmpname()
+  -- Round trip of the reference graph
+  local g = assert(graph.read("test/ref.dot"))
+  assert(g:save(fn))
+  local h = assert(graph.load(fn))
+  debug("  loaded %q: nnodes=%d nedges=%d", h.name, h.nnodes, h.nedges)
+  assert(h.nnodes == g.nnodes and h.nedges == g.nedges)
+  assert(h:writestring() == g:writestring())
   h:close()
+  -- Subgraphs with local defaults and membership
+  local sg = g:subgraph("SG")
+  sg:node("nc1")
+  sg:edge(g:findnode("NE_WEST"), g:findnode("CE_WEST"))
+  assert(g:save(fn))
+  h = assert(graph.load(fn))
+  assert(h:writestring() == g:writestring())
+  local hsg = h:subgraph("SG")
+  assert(hsg.nnodes == 3 and hsg.nedges == 1)
+  h:close()
+  g:close()
+  -- Not a snapshot
+  local h, err = graph.load("test/ref.dot")
+  assert(h == nil and err)
+  os.remove(fn)
   intro("passed")
 end
 
@@ -394,7 +518,13 @@ local function test_close()
   local sg1 = assert(g:subgraph("SG1-close"))
   local sg2 = assert(g:subgraph("SG2-close"))
   local ssg1 = assert(sg1:subgraph("SSG1-close"))
+  local n1, n2 = g:node("n1"), sg1:node("n2")
+  local e = g:edge(n1, n2)
+  n1.data, e.data = {}, {}
   assert(g:close())
+  for _, obj in ipairs{g, sg1, sg2, ssg1, n1, n2, e} do
+    assert(obj.status == "dead")
+  end
   debug("Collecting garbage...")
   collectgarbage("collect")
   intro("passed")
@@ -572,6 +702,60 @@ local function test_node_iterate()
   intro("passed")
 end
 
+local function test_node_bulk()
+  intro("Test node: bulk node access ...")
+  local g = assert(graph.read("test/test_dat1.dot"))
+  local names, ids, nodes = g:nodenames(), g:nodeids(), g:nodes()
+  assert(#names == g.nnodes and #ids == g.nnodes and #nodes == g.nnodes)
+  local i = 0
+  for n in g:walknodes() do
+    i = i + 1
+    assert(names[i] == n.name and ids[i] == n.id and nodes[i] == n)
+  end
+  i = 0
+  for id, name in g:walknodeids() do
+    i = i + 1
+    debug("  %d %s", id, name)
+    assert(ids[i] == id and names[i] == name)
+  end
+  assert(i == g.nnodes)
+  g:close()
+  intro("passed")
+end
+
+local function test_node_proxies()
+  intro("Test node: proxy cache ...")
+  local g = graph.open("G")
+  local keep = g:node("n0")
+  for i = 1, 1000 do g:node("n"..i) end
+  collectgarbage("collect")
+  local kb = collectgarbage("count")
+  for i = 1, 1000 do assert(g:findnode("n"..i)) end
+  collectgarbage("collect")
+  debug("  memory after dropping proxies: %.1f kB -> %.1f kB", kb, collectgarbage("count"))
+  assert(rawequal(g:findnode("n0"), keep))
+  local n = assert(g:findnode("n500"))
+  assert(n.name == "n500" and n.status == "alive" and n.graph == g)
+  local e = assert(g:edge{"n1", "n2"})
+  e = nil
+  collectgarbage("collect")
+  e = assert(g:findedge(g:findnode("n1"), g:findnode("n2")))
+  assert(e.tail.name == "n1" and e.head.name == "n2")
+  n:delete()
+  assert(n.status == "dead" and g:findnode("n500") == nil)
+  -- objects created without proxies get them on demand
+  g:addedges({"a", "b"}, {"b", "c"})
+  local b = assert(g:findnode("b"))
+  assert(rawequal(b, g:findnode("b")))
+  local ab = assert(g:findedge(g:findnode("a"), b))
+  assert(rawequal(ab, g:findedge(g:findnode("a"), b)))
+  b:delete()
+  assert(b.status == "dead" and g:findnode("b") == nil)
+  g:close()
+  assert(keep.status == "dead")
+  intro("passed")
+end
+
 local function test_edge_base()
   intro("Test edge: edge base ...")
   local g = assert(graph.open("G","strictdirected"))
@@ -675,6 +859,41 @@ local function test_edge_iterate()
   intro("passed")
 end
 
+local function test_edge_bulk()
+  intro("Test edge: bulk edge import ...")
+  local g = assert(graph.open("G"))
+  local n = g:addedges({"a", "b", "c", 1}, {"b", "c", "a", 2},
+                       {color = {"red", nil, "blue"}, weight = {1, 2, 3, 4}})
+  assert(n == 4)
+  assert(g.nnodes == 5)
+  assert(g.nedges == 4)
+  local a, b = g:findnode("a"), g:findnode("b")
+  local e = assert(g:findedge(a, b))
+  assert(e.color == "red")
+  assert(e.weight == "1")
+  assert(e.head == b and e.tail == a)
+  local e2 = g:findedge(g:findnode("1"), g:findnode("2"))
+  assert(e2.weight == "4")
+  for nd in g:walknodes() do
+    for ed in nd:walkoutputs() do
+      debug("  %s -> %s", ed.tail.name, ed.head.name)
+    end
+  end
+  -- importing the same list again reuses the existing edges
+  assert(g:addedges({"a", "b"}, {"b", "c"}, {color = {"green"}}) == 0)
+  assert(g.nedges == 4)
+  assert(e.color == "green")
+  -- strict graphs do not duplicate edges
+  local sg = assert(graph.open("SG", "strictdirected"))
+  assert(sg:addedges({"a", "a"}, {"b", "b"}) == 1)
+  assert(sg.nedges == 1)
+  assert(pcall(g.addedges, g, {"a"}, {}) == false)
+  assert(pcall(g.addedges, g, {"a"}, {"b"}, {color = {true}}) == false)
+  sg:close()
+  g:close()
+  intro("passed")
+end
+
 local function _test_attr()
    intro("Test misc: attributes ...")
    local g = graph.open("G")
@@ -746,6 +965,106 @@ local function test_attr()
   intro("passed");
 end
 
+local function test_attrsym()
+  intro("Test misc: attribute symbols  ...")
+  local g = graph.open("G")
+  local sg = g:subgraph("SG")
+  local n1, n2 = g:node("n1"), sg:node("n2")
+  local e = g:edge(n1, n2)
+  assert(g:attrsym("node", "nosuchattr") == nil)
+  local hc = assert(sg:attrsym("node", "color", "black"))
+  debug("%s", tostring(hc))
+  assert(hc:get(n1) == "black")
+  hc:set(n2, "red")
+  assert(n2.color == "red" and hc:get(n2) == "red")
+  n1.color = "blue"
+  assert(hc:get(n1) == "blue")
+  local hl = assert(g:attrsym("edge", "label"))
+  hl:set(e, "n1->n2")
+  assert(e.label == "n1->n2" and hl:get(e) == "n1->n2")
+  assert(pcall(hc.get, hc, e) == false)
+  assert(pcall(hc.get, hc, g) == false)
+  assert(pcall(g.attrsym, g, "nosuchkind", "color") == false)
+  local h = graph.open("H")
+  assert(pcall(hc.get, hc, h:node("n1")) == false)
+  h:close()
+  g:close()
+  assert(pcall(hc.get, hc, n1) == false)
+  intro("passed")
+end
+
+local function test_attrcolumn()
+  intro("Test misc: attribute columns  ...")
+  local g = graph.open("G")
+  local sg = g:subgraph("SG")
+  local n1, n2, n3 = g:node("n1"), sg:node("n2"), sg:node("n3")
+  local e1, e2 = g:edge(n1, n2), g:edge(n2, n3)
+  assert(g:getcolumn("node", "nosuchattr") == nil)
+  assert(g:setcolumn("node", "color", {"red", "green", "blue"}) == 3)
+  assert(n1.color == "red" and n2.color == "green" and n3.color == "blue")
+  local t = g:getcolumn("node", "color")
+  assert(#t == 3 and t[1] == "red" and t[3] == "blue")
+  t = sg:getcolumn("node", "color")
+  assert(#t == 2 and t[1] == "green" and t[2] == "blue")
+  assert(g:setcolumn("edge", "weight", {2, 3.5}) == 2)
+  assert(e1.weight == "2" and e2.weight == "3.5")
+  assert(g:setcolumn("node", "color", {nil, "black"}) == 1)
+  assert(n1.color == "red" and n2.color == "black")
+  t = g:getcolumn("edge", "label")
+  assert(t == nil)
+  assert(g:setcolumn("edge", "label", {}) == 0)
+  t = g:getcolumn("edge", "label")
+  assert(#t == 2 and t[1] == "" and t[2] == "")
+  assert(g:setcolumn("node", "color", {1, 2, 3, 4}) == nil)
+  assert(pcall(g.setcolumn, g, "node", "color", {{}}) == false)
+  assert(pcall(g.getcolumn, g, "graph", "color") == false)
+  g:close()
+  intro("passed")
+end
+
+local function test_numeric()
+  intro("Test misc: numeric attributes  ...")
+  local g = graph.open("G", "directed")
+  local a, b, c = g:node("a"), g:node("b"), g:node("c")
+  a.score = "1.5"
+  local e1, e2 = g:edge(a, b), g:edge(b, c)
+  assert(g:declare_numeric("node", "score"))
+  assert(g:declare_numeric("node", "score"))
+  assert(g:declare_numeric("node", "score", "integer") == nil)
+  assert(g:declare_numeric("edge", "weight", "integer"))
+  assert(a.score == 1.5 and b.score == nil)
+  b.score = 2
+  c.score = "3"
+  assert(b.score + c.score == 5)
+  a.score = nil
+  assert(a.score == nil)
+  assert(pcall(function() a.score = "high" end) == false)
+  assert(pcall(function() e1.weight = 2.5 end) == false)
+  e1.weight, e2.weight = 3, 4
+  assert(e1.weight == 3)
+  if math.type then assert(math.type(e1.weight) == "integer") end
+  local t = g:getcolumn("node", "score")
+  assert(t[1] == nil and t[2] == 2 and t[3] == 3)
+  assert(g:setcolumn("node", "score", {7, nil, 9}) == 2)
+  assert(a.score == 7 and b.score == 2 and c.score == 9)
+  local dist = assert(g:shortestpaths("a", "weight"))
+  assert(dist[3] == 7)
+  assert(g:pagerank{attr = "score"})
+  assert(type(a.score) == "number" and a.score > 0 and a.score < 1)
+  assert(g:attrsym("node", "score") == nil)
+  local s = g:writestring()
+  debug("%s", s)
+  assert(string.find(s, "weight=4", 1, true))
+  assert(g:addedges({"c"}, {"a"}, {weight = {5}}) == 1)
+  assert(g:findedge(c, a).weight == 5)
+  local h = graph.open("H")
+  h:node("x").score = "abc"
+  assert(h:declare_numeric("node", "score") == nil)
+  h:close()
+  g:close()
+  intro("passed")
+end
+
 local function test_anyattrib()
   intro("Test misc: anyattrib  ...")
   g = assert(graph.open("G"))
@@ -772,9 +1091,128 @@ local function test_anyattrib()
   e2[t] = "hey"
   assert(e2[t] == "hey")
   assert(e2[n1.someval] == "hey")
+  debug("Fields survive proxy collection:")
+  n2 = nil
+  collectgarbage("collect")
+  assert(g:findnode("N2").someval == true)
+  assert(not string.find(g:writestring(), "__attrib__", 1, true))
+  local n3 = g:node("N3")
+  n3.someval = {}
+  n3:delete()
+  assert(g:node("N3").someval == nil)
   intro("passed");
 end
 
+local function test_algo_csr()
+  intro("Test algorithms: adjacency snapshot ...")
+  local g = assert(graph.memread("digraph G {a -> b [weight=2]; a -> c [weight=5]; b -> c}"))
+  local off, col, w = assert(g:csr("weight"))
+  debug("  off=%s col=%s w=%s", table.concat(off, ","), table.concat(col, ","), table.concat(w, ","))
+  assert(table.concat(off, ",") == "1,3,4,4")
+  assert(table.concat(col, ",") == "2,3,3")
+  if math.type then assert(math.type(off[1]) == "integer") end
+  assert(w[1] == 2 and w[2] == 5 and w[3] == 1)
+  local off, col, w = g:csr()
+  assert(#col == 3 and w == nil)
+  assert(g:csr("nosuchattr") == nil)
+  g:close()
+  g = assert(graph.memread("graph G {a -- b; b -- c}"))
+  off, col = g:csr()
+  assert(table.concat(off, ",") == "1,2,4,5")
+  assert(table.concat(col, ",") == "2,1,3,2")
+  g:close()
+  intro("passed")
+end
+
+local function test_algo_shortestpaths()
+  intro("Test algorithms: shortest paths ...")
+  local g = assert(graph.memread([[
+    digraph G {a -> b [w=1]; b -> c [w=1]; a -> c [w=5]; c -> d [w=2]; e}
+  ]]))
+  local dist, pred = assert(g:shortestpaths("a", "w"))
+  debug("  dist=%s pred=%s", table.concat(dist, ","), table.concat(pred, ","))
+  assert(dist[1] == 0 and dist[2] == 1 and dist[3] == 2 and dist[4] == 4)
+  assert(dist[5] == math.huge)
+  assert(table.concat(pred, ",") == "0,1,2,3,0")
+  if math.type then assert(math.type(pred[2]) == "integer") end
+  local dist = g:shortestpaths(g:findnode("a"))
+  assert(dist[3] == 1 and dist[4] == 2)
+  local t, d = assert(g:path("a", "d", "w"))
+  assert(table.concat(t, ",") == "a,b,c,d" and d == 4)
+  assert(g:path("a", "e") == nil)
+  assert(g:path("d", "a") == nil)
+  assert(g:shortestpaths("x") == nil)
+  g:close()
+  g = assert(graph.memread("digraph G {a -> b [w=-1]}"))
+  assert(g:shortestpaths("a", "w") == nil)
+  g:close()
+  intro("passed")
+end
+
+local function test_algo_order()
+  intro("Test algorithms: components and ordering ...")
+  local g = assert(graph.memread("digraph G {a -> b -> c -> a; c -> d; d -> e -> d; f}"))
+  local scc = assert(g:scc())
+  assert(#scc == 3)
+  for i, comp in ipairs(scc) do
+    table.sort(comp)
+    debug("  scc %d: %s", i, table.concat(comp, " "))
+  end
+  assert(table.concat(scc[1], " ") == "d e")
+  assert(table.concat(scc[2], " ") == "a b c")
+  assert(table.concat(scc[3], " ") == "f")
+  local comps = assert(g:components())
+  assert(#comps == 2 and #comps[1] == 5 and comps[2][1] == "f")
+  local order, err, cycle = g:toposort()
+  assert(order == nil and err and #cycle >= 2)
+  debug("  cycle: %s", table.concat(cycle, " -> "))
+  g:close()
+  g = assert(graph.memread("digraph G {a -> b; a -> c; b -> d; c -> d; e}"))
+  order = assert(g:toposort())
+  assert(table.concat(order, " ") == "a e b c d")
+  g:close()
+  intro("passed")
+end
+
+local function test_algo_centrality()
+  intro("Test algorithms: centrality ...")
+  local g = assert(graph.memread("digraph G {a -> b -> c -> a; d -> a}"))
+  local rank, niter = assert(g:pagerank{tol = 1e-9})
+  debug("  pagerank: %s after %d iterations", table.concat(rank, " "), niter)
+  local sum = 0
+  for _, r in ipairs(rank) do sum = sum + r end
+  assert(math.abs(sum - 1) < 1e-6)
+  assert(math.abs(rank[4] - 0.15 / 4) < 1e-9)
+  assert(rank[1] > rank[2] and rank[2] > rank[3])
+  local rank2 = assert(g:pagerank{tol = 1e-9, threads = 4})
+  for i = 1, #rank do assert(math.abs(rank[i] - rank2[i]) < 1e-12) end
+  assert(g:pagerank{attr = "rank"})
+  assert(math.abs(tonumber(g:findnode("d").rank) - rank[4]) < 1e-9)
+  g:close()
+  -- large enough for pagerank to split the work among 4 threads
+  local N = 4 * 1024
+  local tails, heads = {}, {}
+  for i = 1, N do
+    tails[2*i-1], heads[2*i-1] = "n"..i, "n"..(i % N + 1)
+    tails[2*i], heads[2*i] = "n"..i, "n"..((i * 7) % N + 1)
+  end
+  g = graph.open("G", "directed")
+  g:addedges(tails, heads)
+  rank = assert(g:pagerank{tol = 1e-12, threads = 1})
+  rank2 = assert(g:pagerank{tol = 1e-12, threads = 4})
+  for i = 1, N do assert(math.abs(rank[i] - rank2[i]) < 1e-9) end
+  g:close()
+  g = assert(graph.memread("graph G {a -- b -- c -- d; b -- e}"))
+  local bc = assert(g:betweenness{threads = 3})
+  local expect = {0, 5, 3, 0, 0}
+  for i = 1, 5 do assert(bc[i] == expect[i]) end
+  bc = assert(g:betweenness{normalized = true})
+  assert(math.abs(bc[2] - 5 / 6) < 1e-12)
+  assert(math.abs(bc[3] - 3 / 6) < 1e-12)
+  g:close()
+  intro("passed")
+end
+
 local function test_contains()
   intro("Test misc: containment  ...")
   local g1 = assert(graph.open("G1"))
@@ -838,12 +1276,207 @@ local function test_layout()
   assert(g:layout("circo"))
   debug("XDOT:")
   assert(g:render("xdot", fn))
+  debug("In memory:")
+  local s = assert(g:renderdata("plain"))
+  assert(string.sub(s, 1, 5) == "graph")
+  local t = assert(g:renderdata("plain", nil, 16))
+  assert(#t[1] == 16 and table.concat(t) == s)
+  debug("Positions and splines:")
+  local pos, bb = assert(g:positions())
+  assert(#pos == 8 and #bb == 4)
+  for i = 1, #pos, 4 do
+    debug("  x=%g y=%g w=%g h=%g", pos[i], pos[i+1], pos[i+2], pos[i+3])
+    assert(pos[i] >= bb[1] and pos[i] <= bb[3] and pos[i+2] > 0)
+  end
+  local spl = assert(g:splines())
+  assert(#spl == 1 and #spl[1] >= 8 and #spl[1] % 2 == 0)
+  g:freelayout()
+  assert(g:positions() == nil)
   debug("Cleanup ...")
   os.remove(fn)
   g:close()
   intro("passed");
 end
 
+local function test_layoutcache()
+  intro("Test layout: layout cache  ...")
+  local function build(nodecl)
+    local g = graph.open("G", "directed")
+    if not nodecl then
+      assert(g:declare{graph = {bb = "", lp = ""}, node = {pos = ""}, edge = {pos = "", lp = ""}})
+    end
+    local c = g:cluster("a", {label = "A"})
+    g:edge{c:node{"n1"}, "n2", label = "e1"}
+    g:edge{"n2", "n3"}
+    return g
+  end
+  graph.layoutcache{enable = true, clear = true}
+  local g1, g2 = build(), build()
+  assert(g1:layout("dot"))
+  local st = graph.layoutcache()
+  assert(st.enabled == true and st.misses == 1 and st.hits == 0 and st.entries == 1)
+  assert(g2:layout("dot"))
+  st = graph.layoutcache()
+  debug("hits=%d misses=%d entries=%d", st.hits, st.misses, st.entries)
+  assert(st.hits == 1 and st.misses == 1)
+  local p1, b1 = g1:positions()
+  local p2, b2 = g2:positions()
+  for i = 1, #p1 do assert(math.abs(p1[i] - p2[i]) < 1e-6) end
+  for i = 1, 4 do assert(math.abs(b1[i] - b2[i]) < 1e-6) end
+  assert(#g2:splines()[1] == #g1:splines()[1])
+  assert(g2:renderdata("plain"))
+  assert(g2:findnode("n1").pos == nil and g2:getcolumn("node", "pos")[1] == "")
+  debug("Undeclared layout attributes miss and stay undeclared:")
+  local g3 = build(true)
+  assert(g3:layout("dot"))
+  g3:freelayout()
+  assert(g3:layout("dot"))
+  st = graph.layoutcache()
+  assert(st.misses == 3 and st.entries == 1)
+  assert(g3:getcolumn("node", "pos") == nil and g3:getcolumn("edge", "lp") == nil)
+  debug("Different attributes miss:")
+  g2:freelayout()
+  g2:findnode("n3").shape = "box"
+  assert(g2:layout("dot"))
+  st = graph.layoutcache()
+  assert(st.misses == 4 and st.entries == 2)
+  g1:close()
+  g2:close()
+  g3:close()
+  graph.layoutcache{enable = false, clear = true}
+  intro("passed")
+end
+
+local function test_layout_async()
+  intro("Test layout: background layout  ...")
+  local g = graph.open("G", "directed")
+  g:edge{"n1", "n2", label = "e1"}
+  g:edge{"n2", "n3"}
+  local h = assert(g:layout_async("dot"))
+  local ok, err = pcall(function() return g.nnodes end)
+  debug("access during layout: %s %s", tostring(ok), tostring(err))
+  assert(ok == false and string.find(err, "graph busy", 1, true))
+  local polls = 0
+  while not h:done() do polls = polls + 1 end
+  debug("polled %d times", polls)
+  assert(h:wait() == true)
+  assert(h:cancel() == false)
+  assert(g.nnodes == 3)
+  local pos = assert(g:positions())
+  assert(#pos == 12)
+  assert(g:renderdata("plain"))
+  debug("Cancel:")
+  local h = assert(g:layout_async("dot"))
+  assert(h:cancel() == true)
+  local ok, err = h:wait()
+  assert(ok == nil and err == "layout cancelled")
+  assert(g.nnodes == 3)
+  debug("Collect running handle:")
+  g:layout_async("circo")
+  collectgarbage("collect")
+  -- the detached worker gives the graph back when it has finished
+  polls = 0
+  while not pcall(function() return g.nnodes end) do polls = polls + 1 end
+  debug("polled %d times", polls)
+  assert(g.nnodes == 3)
+  assert(pcall(g.layout_async, g, "nosuchengine") == false)
+  g:close()
+  intro("passed")
+end
+
+local function test_context()
+  intro("Test layout: graphviz contexts  ...")
+  local g = graph.open("G")
+  g:edge{"n1", "n2", label = "e1"}
+  local ctx = assert(graph.context())
+  assert(ctx:layout(g, "dot"))
+  local s = assert(ctx:renderdata(g, "plain"))
+  assert(string.sub(s, 1, 5) == "graph")
+  local list, n = assert(ctx:plugins("layout"))
+  assert(#list == n and n > 0)
+  ctx:freelayout(g)
+  ctx:close()
+  ctx:close()
+  assert(pcall(ctx.layout, ctx, g, "dot") == false)
+  debug("Default context of this state:")
+  local ctx = assert(graph.context(true))
+  assert(g:layout("dot"))
+  assert(g:renderdata("plain") == s)
+  g:freelayout()
+  ctx:close()
+  assert(g:layout("dot"))
+  assert(g:renderdata("plain") == s)
+  g:freelayout()
+  g:close()
+  intro("passed")
+end
+
+local function test_batchrender()
+  intro("Test layout: batch rendering  ...")
+  local inputs = {}
+  for i = 1, 4 do
+    local g = graph.open("G"..i, "directed")
+    g:edge{"a"..i, "b"..i, "c"..i}
+    inputs[i] = tmpname()..".dot"
+    assert(g:write(inputs[i]))
+    g:close()
+  end
+  inputs[5] = tmpname()..".missing.dot"
+  for _, threads in ipairs{1, 3} do
+    local res, t = assert(graph.batchrender{inputs = inputs, formats = {"plain", "xdot"},
+                                            threads = threads})
+    debug("threads=%d time=%g", threads, t)
+    assert(#res == 5)
+    for i = 1, 4 do
+      assert(res[i].input == inputs[i] and res[i].ok == true and res[i].time >= 0)
+      local base = string.gsub(inputs[i], "%.dot$", "")
+      local f = assert(io.open(base..".plain"))
+      assert(string.sub(f:read("*a"), 1, 5) == "graph")
+      f:close()
+      local g = assert(graph.read(base..".xdot"))
+      assert(g.nnodes == 3)
+      g:close()
+      os.remove(base..".plain")
+      os.remove(base..".xdot")
+    end
+    debug("error: %s", tostring(res[5].error))
+    assert(res[5].ok == nil and string.find(res[5].error, "cannot open"))
+  end
+  for i = 1, 5 do
+    os.remove(inputs[i])
+    os.remove((string.gsub(inputs[i], "%.dot$", "")))
+  end
+  intro("passed")
+end
+
+local function test_renderall()
+  intro("Test layout: render multiple formats  ...")
+  local g = graph.open("G")
+  g:edge{"n1", "n2", label = "n1=>n2"}
+  local t = assert(g:renderall{engine = "dot", formats = {"plain", "xdot", "svg"}})
+  assert(string.sub(t.plain, 1, 5) == "graph")
+  assert(string.find(t.xdot, "_draw_", 1, true))
+  assert(string.find(t.svg, "<svg", 1, true))
+  assert(g:positions() == nil)
+  debug("Into files:")
+  local base = tmpname()
+  t = assert(g:renderall{engine = "dot", formats = {"plain"}, basename = base})
+  assert(t.plain == base..".plain")
+  local f = assert(io.open(t.plain))
+  assert(f:read("*a") == g:renderdata("plain", "dot"))
+  f:close()
+  os.remove(t.plain)
+  os.remove(base)
+  debug("Current layout:")
+  assert(g:layout("dot"))
+  t = assert(g:renderall{formats = {"plain"}})
+  assert(g:positions())
+  g:freelayout()
+  assert(g:renderall{engine = "dot", formats = {"nosuchformat"}} == nil)
+  g:close()
+  intro("passed")
+end
+
 local function test_cluster()
   intro("Test misc: cluster  ...")
   local g,t = graph.open("G", "directed")
@@ -950,6 +1583,9 @@ local tests = {
    test_graph_properties,
    test_graph_meta,
    test_graph_write,
+   test_graph_readall,
+   test_graph_readstream,
+   test_graph_snapshot,
    test_graph_subgraph,
    test_graph_defattr,
    test_graph_iterate,
@@ -965,18 +1601,34 @@ local tests = {
    test_node_degree,
    test_node_degree2,
    test_node_iterate,
+   test_node_bulk,
+   test_node_proxies,
    -- Edge tests
    test_edge_base,
    test_edge_iterate,
+   test_edge_bulk,
    -- Misc tests
    test_attr,
    test_contains,
    test_find,
+   test_attrsym,
+   test_attrcolumn,
+   test_numeric,
    test_anyattrib,
    test_cluster,
    test_graphtab,
+   -- Algorithms
+   test_algo_csr,
+   test_algo_shortestpaths,
+   test_algo_order,
+   test_algo_centrality,
    -- Layout and rendering
    test_layout,
+   test_layoutcache,
+   test_layout_async,
+   test_context,
+   test_batchrender,
+   test_renderall,
    test_huge
       --[[
    ]]